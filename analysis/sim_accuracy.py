@@ -0,0 +1,62 @@
+# Localization error against rfsim ground truth.
+#
+#   rfsim --truth truth.csv --link /tmp/simtty ... &
+#   deauthdetect --port /tmp/simtty &
+#   python3 analysis/sim_accuracy.py truth.csv --duration 60
+#
+# Polls /positions while the simulation runs, then compares every fix with
+# the true position at the middle of the window the fix was computed on.
+import argparse
+import bisect
+import csv
+import json
+import math
+import time
+import urllib.request
+from statistics import mean, median
+
+parser = argparse.ArgumentParser()
+parser.add_argument("truth")
+parser.add_argument("--api", default="http://127.0.0.1:8080")
+parser.add_argument("--duration", type=float, default=30)
+parser.add_argument("--interval", type=float, default=0.5)
+args = parser.parse_args()
+
+fixes = {}  # (attacker, fixed_at) -> fix, the API repeats the latest one
+end = time.time() + args.duration
+while time.time() < end:
+    try:
+        with urllib.request.urlopen(args.api + "/positions", timeout=2) as r:
+            for row in json.load(r)["rows"]:
+                fixes[(row["attack_mac"], row["fixed_at"])] = row
+    except OSError as e:
+        print("poll failed:", e)
+    time.sleep(args.interval)
+
+truth = {}  # attacker -> ([t], [(x, y)])
+with open(args.truth) as f:
+    for row in csv.DictReader(f):
+        ts, pts = truth.setdefault(row["attack_mac"], ([], []))
+        ts.append(int(row["t_us"]))
+        pts.append((float(row["x"]), float(row["y"])))
+
+errors = {}
+for (mac, _), fix in fixes.items():
+    if mac not in truth:
+        continue
+    ts, pts = truth[mac]
+    t = (fix["ts_min"] + fix["ts_max"]) // 2
+    i = min(bisect.bisect_left(ts, t), len(ts) - 1)
+    tx, ty = pts[i]
+    errors.setdefault(mac, []).append(math.hypot(fix["x"] - tx, fix["y"] - ty))
+
+print("\n==============================")
+print("   LOCALIZATION ERROR VS GROUND TRUTH")
+print("==============================\n")
+for mac, errs in sorted(errors.items()):
+    errs.sort()
+    p90 = errs[int(0.9 * (len(errs) - 1))]
+    print(f"{mac}: {len(errs)} fixes  mean={mean(errs):.2f} m  "
+          f"median={median(errs):.2f} m  p90={p90:.2f} m  max={errs[-1]:.2f} m")
+if not errors:
+    print("no fixes matched the ground truth")
@@ -20,6 +20,7 @@ static const int64_t TIME_WIND_US =
 #define MAX_DEAUTH_BUFFER 1024
 #define EVENT_QUEUE_LEN                                                        \
   8 // Tune this (ISR blocking/overflowing queue with packets)
+#define HEARTBEAT_MS 5000 // Pi marks a sensor stale after a few missed ones
 
 // Initialize global "volatile" vairables
 static volatile int total_deauths = 0;
@@ -241,7 +242,16 @@ void app_main(void) {
   init_wifi_sniffer();
 
   printf("Sniffer is running in monitor mode. Capturing packets...\n");
+
+  // Heartbeat: no attacker (all-zero MAC) and no frames, so the Pi can tell
+  // a quiet sensor from a dead one
+  wifi_deauth_event_t heartbeat;
+  memset(&heartbeat, 0, sizeof(heartbeat));
+  esp_wifi_get_mac(WIFI_IF_STA, heartbeat.sensor_mac);
   while (1) {
-    vTaskDelay(pdMS_TO_TICKS(5000));
+    if (xQueueSend(event_queue, &heartbeat, 0) != pdTRUE) {
+      printf("event queue full, heartbeat skipped\n");
+    }
+    vTaskDelay(pdMS_TO_TICKS(HEARTBEAT_MS));
   }
 }
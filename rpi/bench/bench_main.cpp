@@ -0,0 +1,444 @@
+// Microbenchmarks for the Pi hot paths.
+//
+// Prints one JSON object per line so results can be diffed/plotted:
+//   {"bench":"sort_bucket","param":10000,"iterations":...,"ns_per_op":...}
+// A benchmark with a param reports per item (per event/row), not per call.
+//
+//   deauthdetect_bench [--filter SUBSTRING] [--min-time-ms N]
+//
+// --alloc-check instead pushes events through the steady-state ingest path
+// and fails (exit 1) if any of them touched the heap. Needs a build with
+// -DDEAUTH_ALLOC_TRACKING=ON.
+#include "../include/alert_rules.h"
+#include "../include/alloc_counter.h"
+#include "../include/deauth_event.h"
+#include "../include/event_journal.h"
+#include "../include/federation.h"
+#include "../include/fingerprint.h"
+#include "../include/incidents.h"
+#include "../include/ingest.h"
+#include "../include/localization.h"
+#include "../include/sensor_health.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <duckdb.hpp>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+// Defined in main.cpp for the real binary
+atomic<bool> keep_running(true);
+
+static string filter;
+static int64_t min_time_ns = 200 * 1000000LL;
+
+template <class T> static void do_not_optimize(T &&value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+static int64_t now_ns() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// fn(iterations) runs the body that many times; items is work per iteration
+static void bench(const string &name, int64_t param, int64_t items,
+                  const function<void(int64_t)> &fn) {
+  if (!filter.empty() && name.find(filter) == string::npos)
+    return;
+
+  fn(1); // warm up
+  int64_t iters = 1, elapsed = 0;
+  while (true) {
+    int64_t start = now_ns();
+    fn(iters);
+    elapsed = now_ns() - start;
+    if (elapsed >= min_time_ns || iters >= (1LL << 40))
+      break;
+    // aim a bit past the minimum time
+    int64_t next = elapsed > 0 ? iters * min_time_ns * 12 / 10 / elapsed
+                               : iters * 100;
+    iters = max(iters * 2, min(next, iters * 100));
+  }
+
+  double per_op = (double)elapsed / (double)(iters * items);
+  cout << "{\"bench\":\"" << name << "\",\"param\":" << param
+       << ",\"iterations\":" << iters << ",\"ns_per_op\":" << per_op
+       << ",\"ops_per_s\":" << (per_op > 0 ? 1e9 / per_op : 0) << "}"
+       << endl;
+}
+
+static wifi_deauth_event_t make_event(mt19937 &rng, int64_t ts) {
+  wifi_deauth_event_t ev;
+  for (int i = 0; i < 6; ++i) {
+    ev.attack_mac[i] = rng() & 0xFF;
+    ev.sensor_mac[i] = rng() & 0xFF;
+  }
+  ev.rssi_mean = -30 - (int)(rng() % 60);
+  ev.rssi_variance = (rng() % 1000) / 100.0f;
+  ev.frame_count = 30 + rng() % 50;
+  ev.timestamp = ts;
+  return ev;
+}
+
+static void bench_localization() {
+  mt19937 rng(42);
+  uint8_t mac[6] = {0x78, 0x1C, 0x3C, 0xE3, 0xAB, 0xCC};
+  bench("bytes_to_mac", 0, 1, [&](int64_t n) {
+    for (int64_t i = 0; i < n; ++i) {
+      mac[5] = (uint8_t)i;
+      string s = bytes_to_mac(mac);
+      do_not_optimize(s);
+    }
+  });
+
+  vector<int> rssis(1024);
+  for (auto &r : rssis)
+    r = -30 - (int)(rng() % 60);
+  bench("rssi_to_distance", 0, 1, [&](int64_t n) {
+    double sum = 0;
+    for (int64_t i = 0; i < n; ++i)
+      sum += rssi_to_distance(rssis[i & 1023]);
+    do_not_optimize(sum);
+  });
+
+  bench("trilaterate", 0, 1, [&](int64_t n) {
+    double sum = 0;
+    for (int64_t i = 0; i < n; ++i) {
+      double r = 1.0 + (i & 7) * 0.1;
+      auto [x, y] = trilaterate(0, 0, r, 2, 0, 1.5, 0, 2, 1.2);
+      sum += x + y;
+    }
+    do_not_optimize(sum);
+  });
+
+  for (size_t sensors : {3, 8, 32}) {
+    vector<pair<double, double>> coords;
+    vector<double> ranges;
+    for (size_t i = 0; i < sensors; ++i) {
+      coords.push_back(
+          {(double)(rng() % 100) / 10, (double)(rng() % 100) / 10});
+      ranges.push_back(1.0 + (rng() % 50) / 10.0);
+    }
+    bench("multilateration_least_squares", sensors, 1, [&](int64_t n) {
+      double x = 0, y = 0, sum = 0;
+      for (int64_t i = 0; i < n; ++i) {
+        ranges[0] = 1.0 + (i & 7) * 0.1;
+        multilateration_least_squares(coords, ranges, x, y);
+        sum += x + y;
+      }
+      do_not_optimize(sum);
+    });
+  }
+}
+
+// one fix against a side x side model grid of the deployed sensors
+static void bench_fingerprint() {
+  if (!filter.empty() &&
+      string("fingerprint_knn").find(filter) == string::npos)
+    return; // maps take a while to build
+  mt19937 rng(11);
+  for (int side : {32, 100, 200}) {
+    RadioMap map;
+    map.build_from_model(sensor_positions, -1, -1, 3, 3, 4.0 / (side - 1));
+    vector<vector<float>> lives(64);
+    for (auto &live : lives) {
+      double x = (rng() % 300) / 100.0, y = (rng() % 300) / 100.0;
+      for (const auto &mac : map.sensor_macs()) {
+        auto pos = sensor_positions[mac];
+        live.push_back((float)distance_to_rssi(
+            hypot(x - pos.first, y - pos.second)));
+      }
+    }
+    bench("fingerprint_knn", (int64_t)map.cells(), 1, [&](int64_t n) {
+      double x = 0, y = 0, sum = 0;
+      for (int64_t i = 0; i < n; ++i) {
+        map.locate(lives[i & 63], 4, x, y);
+        sum += x + y;
+      }
+      do_not_optimize(sum);
+    });
+  }
+}
+
+static void bench_sort() {
+  mt19937 rng(7);
+  for (int64_t size : {1000, 10000, 100000}) {
+    // what insert_events really sees: arrival order with a few stragglers
+    vector<SequencedEvent> nearly(size);
+    for (int64_t i = 0; i < size; ++i)
+      nearly[i] = {make_event(rng, 1000000 + i * 20), (uint64_t)i + 1};
+    for (int64_t i = 0; i < size / 100; ++i)
+      swap(nearly[rng() % size], nearly[rng() % size]);
+
+    vector<SequencedEvent> shuffled = nearly;
+    shuffle(shuffled.begin(), shuffled.end(), rng);
+
+    vector<SequencedEvent> work;
+    bench("sort_bucket/nearly_sorted", size, size, [&](int64_t n) {
+      for (int64_t i = 0; i < n; ++i) {
+        work = nearly;
+        sort_bucket(work);
+        do_not_optimize(work);
+      }
+    });
+    bench("sort_bucket/shuffled", size, size, [&](int64_t n) {
+      for (int64_t i = 0; i < n; ++i) {
+        work = shuffled;
+        sort_bucket(work);
+        do_not_optimize(work);
+      }
+    });
+  }
+}
+
+static void bench_appender() {
+  duckdb::DuckDB db(nullptr);
+  duckdb::Connection con(db);
+  con.Query("CREATE TABLE events (timestamp BIGINT, attack_mac VARCHAR(17), "
+            "sensor_mac VARCHAR(17), rssi_mean INT, rssi_variance FLOAT, "
+            "frame_count INT, seq UBIGINT)");
+  duckdb::Appender appender(con, "events");
+
+  mt19937 rng(3);
+  vector<wifi_deauth_event_t> events(4096);
+  for (size_t i = 0; i < events.size(); ++i)
+    events[i] = make_event(rng, 1000000 + i);
+
+  // same row shape as insert_events, one Flush per batch
+  for (int64_t batch : {1, 16, 256, 4096}) {
+    bench("appender", batch, batch, [&](int64_t n) {
+      for (int64_t i = 0; i < n; ++i) {
+        for (int64_t b = 0; b < batch; ++b) {
+          const auto &ev = events[b];
+          appender.AppendRow(ev.timestamp, bytes_to_mac(ev.attack_mac).c_str(),
+                             bytes_to_mac(ev.sensor_mac).c_str(), ev.rssi_mean,
+                             ev.rssi_variance, ev.frame_count, (uint64_t)b);
+        }
+        appender.Flush();
+      }
+    });
+  }
+  appender.Close();
+}
+
+// uplink batches: 3 sensors, a few attackers, arrival-order timestamps
+static void bench_federation() {
+  mt19937 rng(9);
+  vector<wifi_deauth_event_t> batch(512);
+  int64_t ts = 1700000000000000LL;
+  for (auto &ev : batch) {
+    ev = make_event(rng, ts += 50 + rng() % 500);
+    ev.attack_mac[5] = rng() % 4;
+    memset(ev.attack_mac, 0xDE, 5);
+    memset(ev.sensor_mac, 0x78, 5);
+    ev.sensor_mac[5] = rng() % 3;
+  }
+  string payload;
+  bench("federation_encode", (int64_t)batch.size(), batch.size(),
+        [&](int64_t n) {
+          for (int64_t i = 0; i < n; ++i) {
+            payload.clear();
+            encode_batch(batch.data(), batch.size(), payload);
+          }
+          do_not_optimize(payload);
+        });
+  vector<wifi_deauth_event_t> decoded;
+  bench("federation_decode", (int64_t)batch.size(), batch.size(),
+        [&](int64_t n) {
+          for (int64_t i = 0; i < n; ++i)
+            decode_batch((const uint8_t *)payload.data(), payload.size(),
+                         decoded);
+          do_not_optimize(decoded);
+        });
+  if (filter.empty() || string("federation").find(filter) != string::npos)
+    cerr << "[bench] federation batch: " << payload.size() / batch.size()
+         << " bytes/event vs " << sizeof(wifi_deauth_event_t) << " raw"
+         << endl;
+}
+
+static void bench_incidents() {
+  if (!filter.empty() &&
+      string("interval_overlap").find(filter) == string::npos &&
+      string("incident_event").find(filter) == string::npos)
+    return; // don't build big trees for nothing
+
+  // an attack every ~10 s lasting up to 5 min, query one minute of them
+  for (int64_t n : {10000, 1000000}) {
+    IntervalTree tree;
+    mt19937 rng(9);
+    int64_t t = 0;
+    for (int64_t i = 0; i < n; ++i) {
+      t += rng() % 20000000;
+      tree.insert(t, t + rng() % 300000000, i);
+    }
+    vector<int64_t> hits;
+    bench("interval_overlap", n, 1, [&](int64_t iters) {
+      for (int64_t i = 0; i < iters; ++i) {
+        int64_t from = (int64_t)(rng() % (uint64_t)t);
+        hits.clear();
+        tree.overlapping(from, from + 60000000, 100, hits);
+        do_not_optimize(hits);
+      }
+    });
+  }
+
+  IncidentCorrelator incidents(30000000, 100000);
+  mt19937 rng(10);
+  vector<wifi_deauth_event_t> pattern;
+  for (int i = 0; i < 64; ++i)
+    pattern.push_back(make_event(rng, 0));
+  for (size_t i = 0; i < pattern.size(); ++i)
+    memcpy(pattern[i].sensor_mac, pattern[i % 3].sensor_mac, 6);
+  int64_t ts = 1;
+  bench("incident_event", 0, 1, [&](int64_t iters) {
+    for (int64_t i = 0; i < iters; ++i) {
+      wifi_deauth_event_t &ev = pattern[i % pattern.size()];
+      ev.timestamp = ts += 100;
+      incidents.on_event(ev);
+    }
+  });
+}
+
+static void bench_journal() {
+  if (!filter.empty() && string("journal_append").find(filter) == string::npos)
+    return; // don't create files for nothing
+  char dir[] = "/tmp/deauth_bench_journalXXXXXX";
+  if (!mkdtemp(dir))
+    return;
+  {
+    EventJournal journal(dir, 64 * 1024 * 1024, 100, 0);
+    vector<SequencedEvent> none;
+    if (journal.replay(none) && journal.start()) {
+      mt19937 rng(5);
+      wifi_deauth_event_t ev = make_event(rng, 1);
+      bench("journal_append", 0, 1, [&](int64_t n) {
+        uint64_t seq = 0;
+        for (int64_t i = 0; i < n; ++i) {
+          ev.timestamp++;
+          seq = journal.append(ev);
+        }
+        journal.commit(seq); // let segments get recycled
+      });
+      journal.stop();
+    }
+  }
+  string cmd = string("rm -rf ") + dir;
+  if (system(cmd.c_str()) != 0)
+    cerr << "[bench] Couldn't remove " << dir << endl;
+}
+
+// Reader + inserter work for one event, minus the journal (a segment roll
+// allocates once per 64 MB) and DuckDB (its allocations aren't ours to fix).
+// Single threaded so the thread counter sees all of it.
+static int alloc_check() {
+  if (!alloc_tracking_enabled()) {
+    cerr << "[bench] --alloc-check needs -DDEAUTH_ALLOC_TRACKING=ON" << endl;
+    return 2;
+  }
+
+  char rules_path[] = "/tmp/deauth_bench_rulesXXXXXX";
+  int rules_fd = mkstemp(rules_path);
+  if (rules_fd < 0)
+    return 2;
+  close(rules_fd);
+  {
+    ofstream rules(rules_path);
+    rules << "rate flood threshold=500 clear=100\n"
+          << "new_mac fresh\n";
+  }
+  AlertEngine alerts;
+  bool loaded = alerts.load(rules_path);
+  unlink(rules_path);
+  if (!loaded)
+    return 2;
+
+  IngestConfig cfg;
+  IngestQueue queue(cfg);
+  SensorHealth health(12000000, 30000000);
+  IncidentCorrelator incidents(30000000, 1000);
+  uint64_t formatted = 0;
+  ReorderBuffer reorder(cfg.bucket_capacity, queue.stats,
+                        [&](vector<SequencedEvent> &bucket) {
+                          char attack[18], sensor[18];
+                          for (const auto &p : bucket) { // append_bucket
+                            bytes_to_mac(p.event.attack_mac, attack);
+                            bytes_to_mac(p.event.sensor_mac, sensor);
+                            formatted += attack[0] + sensor[0];
+                          }
+                        });
+
+  // a handful of attackers seen by three sensors, 10k events/s
+  mt19937 rng(11);
+  vector<wifi_deauth_event_t> pattern;
+  for (int i = 0; i < 64; ++i)
+    pattern.push_back(make_event(rng, 0));
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    memcpy(pattern[i].attack_mac, pattern[i % 8].attack_mac, 6);
+    memcpy(pattern[i].sensor_mac, pattern[i % 3].sensor_mac, 6);
+  }
+
+  // synthetic clock from an hour ago so ingest_event keeps our stamps
+  int64_t source_ts =
+      chrono::duration_cast<chrono::microseconds>(
+          chrono::system_clock::now().time_since_epoch())
+          .count() -
+      3600LL * 1000000;
+  auto run = [&](int64_t n) {
+    wifi_deauth_event_t ev;
+    uint64_t seq;
+    for (int64_t i = 0; i < n; ++i) {
+      ev = pattern[i % pattern.size()];
+      source_ts += 100;
+      ingest_event(ev, source_ts, &queue, nullptr, &health, &alerts);
+      while (queue.size() > 0 && queue.pop(ev, seq)) {
+        alerts.on_event(ev);
+        incidents.on_event(ev);
+        reorder.add(ev, seq);
+      }
+    }
+  };
+
+  const int64_t warmup = 200000, measured = 1000000;
+  run(warmup); // maps, bucket and first alerts settle here
+  uint64_t before = thread_alloc_count();
+  run(measured);
+  uint64_t allocs = thread_alloc_count() - before;
+  do_not_optimize(formatted);
+
+  cout << "{\"bench\":\"alloc_check\",\"param\":" << measured
+       << ",\"allocations\":" << allocs
+       << ",\"per_event\":" << (double)allocs / measured << "}" << endl;
+  return allocs == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i)
+    if (strcmp(argv[i], "--alloc-check") == 0)
+      return alloc_check();
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--filter") == 0)
+      filter = argv[i + 1];
+    else if (strcmp(argv[i], "--min-time-ms") == 0)
+      min_time_ns = atoll(argv[i + 1]) * 1000000LL;
+  }
+
+  bench_localization();
+  bench_fingerprint();
+  bench_sort();
+  bench_appender();
+  bench_journal();
+  bench_incidents();
+  bench_federation();
+  return 0;
+}
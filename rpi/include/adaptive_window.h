@@ -0,0 +1,71 @@
+#ifndef ADAPTIVE_WINDOW_H
+#define ADAPTIVE_WINDOW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Sums for one (attacker, sensor) pair over one slot of the analysis
+// query, so any window made of whole slots can be averaged exactly
+struct WindowSlot {
+  std::string sensor_mac;
+  int64_t slot; // slot start (us)
+  double rssi_sum;
+  double variance_sum;
+  int64_t frames;
+  int64_t events;
+};
+
+struct SensorAverage {
+  std::string sensor_mac;
+  float avg_rssi;
+  float avg_variance;
+  int frame_count;
+  int events;
+};
+
+// Per-attacker localization window. A window that doesn't reach enough
+// sensors doubles (up to max_us) right away; a window where every sensor
+// already has dense data in its newer half halves (down to min_us), one step
+// per analysis round. Slow attacks get wider windows instead of failed
+// fixes, fast ones get fresher fixes.
+class AdaptiveWindow {
+public:
+  AdaptiveWindow(int64_t min_us, int64_t max_us);
+
+  int64_t max_window() const { return max_us; }
+  int64_t slot_width() const { return slot_us; }
+
+  // slots: everything queried for this attacker over the max window ending
+  // at ts_max. want: sensors needed for a fix, already capped by the caller
+  // at how many sensors are alive. The averages go to out[0, used); out only
+  // grows so its strings are reused from call to call. Returns the window
+  // used.
+  int64_t select(const std::string &attacker, const WindowSlot *slots,
+                 size_t count, int64_t ts_max, size_t want,
+                 std::vector<SensorAverage> &out, size_t &used);
+
+  // forget attackers not analysed since before ts_max - max window
+  void prune(int64_t ts_max);
+
+private:
+  struct State {
+    int64_t window_us;
+    int64_t last_ts;
+  };
+
+  size_t sum_window(const WindowSlot *slots, size_t count, int64_t from,
+                    std::vector<SensorAverage> &out);
+
+  int64_t min_us;
+  int64_t max_us;
+  int64_t slot_us;
+  std::map<std::string, State> state;
+  // sum_window scratch, kept across calls
+  std::vector<double> rssi, variance;
+  std::vector<SensorAverage> newer;
+};
+
+#endif // ADAPTIVE_WINDOW_H
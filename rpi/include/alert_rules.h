@@ -0,0 +1,125 @@
+#ifndef ALERT_RULES_H
+#define ALERT_RULES_H
+
+#include "alert_sinks.h"
+#include "deauth_event.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Streaming alert rules, evaluated on every event as the inserter takes it
+// off the queue instead of on the 2 s SQL poll.
+//
+// Rules file, one rule or sink per line ('#' starts a comment):
+//
+//   rate     <name> threshold=<frames/s> [clear=<frames/s>] [debounce_s=N]
+//   new_mac  <name> [forget_s=N]
+//   zone     <name> polygon=x,y;x,y;x,y... [exit_fixes=N] [debounce_s=N]
+//   silent   <name> timeout_s=N [debounce_s=N]
+//   sink     file path=<file>
+//   sink     syslog
+//   sink     webhook [host=127.0.0.1] port=N [path=/]
+//
+// silent counts heartbeats as well as events, so it means the sensor (or its
+// gateway link) is down, not just that nobody is attacking.
+//
+// Every rule keeps its state per key (attacker, sensor or attacker+zone).
+// A key fires once when its condition starts to hold and has to go back
+// below the clear level (hysteresis) before it can fire again; debounce_s is
+// the minimum time between two alerts for the same key.
+//
+// Per event work is a fixed number of hash lookups per rule. Alerts are
+// handed to a dispatcher thread so slow sinks never stall ingest.
+class AlertEngine {
+public:
+  AlertEngine();
+  ~AlertEngine();
+
+  bool load(const std::string &path);
+  bool empty() const { return rules.empty(); }
+
+  void start();
+  void stop();
+
+  void on_event(const wifi_deauth_event_t &event);
+  // sensor liveness for the silent rules, from the producer thread
+  void on_heartbeat(const uint8_t sensor_mac[6], int64_t ts);
+  void on_position(const std::string &attack_mac, double x, double y,
+                   int64_t ts);
+
+  uint64_t fired() const { return fired_count.load(); }
+  uint64_t dropped() const { return dropped_count.load(); }
+
+private:
+  enum class Kind { Rate, NewMac, Zone, Silent };
+
+  struct Rule {
+    Kind kind;
+    std::string name;
+    double threshold = 0;
+    double clear = 0;
+    int64_t debounce_us = 0;
+    int64_t forget_us = 0;
+    int64_t timeout_us = 0;
+    int exit_fixes = 2;
+    std::vector<std::pair<double, double>> polygon;
+  };
+
+  // Per key state shared by all rule kinds
+  struct KeyState {
+    bool active = false;
+    bool suppressed = false; // last firing was debounced
+    int64_t last_fired = 0;
+    int64_t last_seen = 0;
+    uint64_t owner = 0; // rate: sensor that raised the alert
+    int outside = 0;    // zone: consecutive fixes outside
+  };
+
+  // 1 s sliding window in 100 ms buckets
+  struct RateWindow {
+    int64_t bucket_id[10] = {};
+    int64_t frames[10] = {};
+    void add(int64_t ts, int64_t n);
+    double rate(int64_t ts) const;
+  };
+
+  void tick_loop();
+  void dispatch_loop();
+  void raise(const Rule &rule, KeyState &st, const std::string &key,
+             bool firing, const std::string &message, int64_t ts);
+  void sensor_heard(uint64_t sensor, int64_t ts);
+
+  static uint64_t mac_key(const uint8_t mac[6]);
+  static std::string key_to_mac(uint64_t key);
+
+  std::vector<Rule> rules;
+  std::vector<std::unique_ptr<AlertSink>> sinks;
+
+  std::mutex state_mutex;
+  // rules[i] -> key -> state
+  std::vector<std::unordered_map<uint64_t, KeyState>> states;
+  std::vector<std::unordered_map<std::string, KeyState>> zone_states;
+  // attacker -> sensor -> frames/s window
+  std::unordered_map<uint64_t, std::unordered_map<uint64_t, RateWindow>> rates;
+  std::unordered_map<uint64_t, int64_t> sensor_seen; // event or heartbeat
+
+  std::deque<Alert> outbox;
+  std::mutex outbox_mutex;
+  std::condition_variable outbox_cv;
+
+  std::atomic<bool> running{false};
+  std::thread ticker;
+  std::thread dispatcher;
+  std::atomic<uint64_t> fired_count{0};
+  std::atomic<uint64_t> dropped_count{0};
+};
+
+#endif // ALERT_RULES_H
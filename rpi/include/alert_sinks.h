@@ -0,0 +1,56 @@
+#ifndef ALERT_SINKS_H
+#define ALERT_SINKS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+struct Alert {
+  std::string rule;    // rule name from the rules file
+  std::string kind;    // rate, new_mac, zone, silent
+  std::string key;     // attacker mac, sensor mac or attacker@zone
+  std::string state;   // "firing" or "resolved"
+  std::string message;
+  int64_t ts;          // us
+};
+
+std::string alert_to_json(const Alert &alert);
+
+class AlertSink {
+public:
+  virtual ~AlertSink() {}
+  virtual void send(const Alert &alert) = 0;
+};
+
+// One JSON object per line
+class FileAlertSink : public AlertSink {
+public:
+  explicit FileAlertSink(const std::string &path);
+  ~FileAlertSink();
+  bool ok() const { return file != nullptr; }
+  void send(const Alert &alert) override;
+
+private:
+  FILE *file;
+};
+
+class SyslogAlertSink : public AlertSink {
+public:
+  SyslogAlertSink();
+  ~SyslogAlertSink();
+  void send(const Alert &alert) override;
+};
+
+// POSTs the JSON alert to a local HTTP endpoint
+class WebhookAlertSink : public AlertSink {
+public:
+  WebhookAlertSink(const std::string &host, int port, const std::string &path);
+  void send(const Alert &alert) override;
+
+private:
+  std::string host;
+  int port;
+  std::string path;
+};
+
+#endif // ALERT_SINKS_H
@@ -0,0 +1,14 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// Heap allocation accounting for diagnostics. A build configured with
+// -DDEAUTH_ALLOC_TRACKING=ON replaces the global operator new/delete with
+// counting versions; otherwise nothing is hooked and everything reads 0.
+bool alloc_tracking_enabled();
+uint64_t alloc_count(); // all threads
+uint64_t alloc_bytes();
+uint64_t thread_alloc_count(); // calling thread only
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,104 @@
+#ifndef API_SERVER_H
+#define API_SERVER_H
+
+#include "attacker_tracker.h"
+#include "incidents.h"
+#include "ingest.h"
+#include "query_scheduler.h"
+#include "sensor_health.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Small HTTP/JSON query API bound to 127.0.0.1.
+//
+//   GET /attackers?active_s=10        attackers seen in the last N seconds
+//   GET /positions                    latest position fix per attacker
+//   GET /sensors?window_s=60          per-sensor stats over the last N seconds
+//   GET /events?from=&to=&limit=&attacker=
+//   GET /stats                        API counters
+//   GET /health                       sensor liveness (online/stale/offline)
+//   GET /incidents?from=&to=&limit=&attacker=
+//                                     attack incidents overlapping [from, to]
+//
+// "Last N seconds" is measured back from the ingest watermark (newest
+// committed timestamp, nudged by 1 us when a flush only had late rows), so a
+// response only depends on the watermark and the request. Responses are
+// cached per request and reused until the watermark moves, which it does on
+// every flush, so polling dashboards stay off DuckDB between flushes.
+//
+// Requests are parsed on a fixed pool of workers and their SQL goes through
+// the QueryScheduler at interactive priority with a timeout, so nothing here
+// ever touches the ingest thread's writer connection.
+class ApiServer {
+public:
+  ApiServer(QueryScheduler &scheduler, const std::atomic<int64_t> &watermark,
+            AttackerTracker &tracker, int port, int workers, int backlog,
+            int timeout_ms);
+  ~ApiServer();
+
+  bool start();
+  void stop();
+
+  // Optional, adds the ingest load shedding counters to /stats
+  void set_ingest_stats(const IngestStats *stats) { ingest_stats = stats; }
+  // Optional, enables /health
+  void set_sensor_health(const SensorHealth *h) { health = h; }
+  // Optional, enables /incidents (served from memory, not DuckDB)
+  void set_incidents(const IncidentCorrelator *c) { incidents = c; }
+
+private:
+  struct CacheEntry {
+    int64_t watermark;
+    std::string body;
+  };
+
+  void accept_loop();
+  void worker_loop();
+  void handle_client(int fd);
+  // wm is the watermark the response gets cached under
+  int route(const std::string &path,
+            const std::map<std::string, std::string> &params, int64_t wm,
+            std::string &body);
+  std::string run_query(const std::string &sql, int &status);
+
+  bool cache_get(const std::string &key, int64_t wm, std::string &body);
+  void cache_put(const std::string &key, int64_t wm, const std::string &body);
+
+  QueryScheduler &scheduler;
+  const std::atomic<int64_t> &watermark;
+  AttackerTracker &tracker;
+  const IngestStats *ingest_stats = nullptr;
+  const SensorHealth *health = nullptr;
+  const IncidentCorrelator *incidents = nullptr;
+  int port;
+  int num_workers;
+  size_t backlog;
+  int timeout_ms;
+
+  int listen_fd = -1;
+  std::atomic<bool> running{false};
+  std::thread acceptor;
+  std::vector<std::thread> workers;
+
+  // accepted sockets waiting for a worker (bounded by backlog)
+  std::deque<int> pending;
+  std::mutex pending_mutex;
+  std::condition_variable pending_cv;
+
+  std::map<std::string, CacheEntry> cache;
+  std::mutex cache_mutex;
+
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> cache_hits{0};
+  std::atomic<uint64_t> cache_misses{0};
+  std::atomic<uint64_t> rejected{0};
+};
+
+#endif // API_SERVER_H
@@ -0,0 +1,32 @@
+#ifndef ATTACKER_TRACKER_H
+#define ATTACKER_TRACKER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Latest position fix for one attacker
+struct AttackerFix {
+  std::string attack_mac;
+  double x;
+  double y;
+  int sensors;      // how many sensors went into the fix
+  int64_t ts_min;   // analysis window the fix was computed on
+  int64_t ts_max;
+  int64_t fixed_at; // wall clock (us) when the fix was computed
+};
+
+// Written by the analysis loop, read by the API server
+class AttackerTracker {
+public:
+  void update(const AttackerFix &fix);
+  std::vector<AttackerFix> snapshot() const;
+
+private:
+  mutable std::mutex mtx;
+  std::map<std::string, AttackerFix> latest;
+};
+
+#endif // ATTACKER_TRACKER_H
@@ -0,0 +1,28 @@
+#ifndef DEAUTH_EVENT_H
+#define DEAUTH_EVENT_H
+
+#include <cstdint>
+#include <string>
+
+// Must match the struct sent by the sensors and forwarded by the gateway
+struct __attribute__((packed)) wifi_deauth_event_t {
+  uint8_t attack_mac[6];
+  uint8_t sensor_mac[6];
+  int8_t rssi_mean;
+  float rssi_variance;
+  int frame_count;
+  int64_t timestamp;
+};
+
+bool operator>(const wifi_deauth_event_t &a, const wifi_deauth_event_t &b);
+
+// Sensors send a heartbeat every few seconds so a quiet sensor can be told
+// apart from a dead one: all-zero attack_mac and no frames
+bool is_heartbeat(const wifi_deauth_event_t &event);
+
+int64_t now_us();
+std::string bytes_to_mac(const uint8_t mac[6]);
+// Same text into out (17 chars + NUL), no allocation
+void bytes_to_mac(const uint8_t mac[6], char out[18]);
+
+#endif // DEAUTH_EVENT_H
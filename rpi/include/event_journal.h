@@ -0,0 +1,117 @@
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include "deauth_event.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An event with its journal sequence number, 0 = not journaled. The number
+// goes into the events table's seq column so replay can tell exactly which
+// rows made it into DB.
+struct SequencedEvent {
+  wifi_deauth_event_t event;
+  uint64_t seq;
+};
+
+// Append-only journal of decoded events, written before they are queued.
+//
+// The journal is a directory of fixed-size, memory-mapped segment files
+// (seg-00000001.jnl, ...). Each record is one event plus a CRC32, so a torn
+// write at the tail of a segment is detected on replay. A flusher thread
+// msyncs dirty pages every fsync interval (group commit) and prepares the
+// next segment ahead of time so rolling over never creates files on the
+// reader thread.
+//
+// Every record gets a sequence number, increasing across restarts (the
+// next one continues from the newest record or commit mark on disk), so
+// the key doesn't depend on the wall clock, which a Pi without an RTC may
+// set backwards after a power cut. commit(seq) means every record with a
+// sequence <= seq is either in DuckDB or was shed on purpose. The commit
+// mark is persisted next to the segments. A segment whose records are all
+// committed is unmapped and closed, and deleted. On startup, replay()
+// returns every record past the mark.
+//
+// keep_bytes > 0 is for an in-memory DB: committed segments stay on disk,
+// newest keep_bytes of them, and replay returns every record still on disk,
+// since the journal is the only copy that survives a restart.
+class EventJournal {
+public:
+  EventJournal(const std::string &dir, size_t segment_bytes, int fsync_ms,
+               size_t keep_bytes);
+  ~EventJournal();
+
+  // Reads the commit mark and all valid records past it, in journal order
+  bool replay(std::vector<SequencedEvent> &pending);
+  // Continue numbering past seq, for a DB that holds rows from an older
+  // journal (directory wiped or replaced). Before start() only.
+  void skip_to(uint64_t seq);
+  uint64_t committed() const { return commit_mark.load(); }
+  // Newest sequence handed out (or found by replay)
+  uint64_t last_seq() const { return next_seq - 1; }
+
+  bool start();
+  void stop();
+
+  // Reader thread only, returns the record's sequence number
+  uint64_t append(const wifi_deauth_event_t &event);
+  // Inserter thread, after the appender flushed
+  void commit(uint64_t seq);
+
+  uint64_t appended() const { return appended_count.load(); }
+  uint64_t syncs() const { return sync_count.load(); }
+
+private:
+  struct Segment {
+    uint32_t index = 0;
+    std::string path;
+    int fd = -1;
+    uint8_t *base = nullptr;
+    size_t size = 0;
+    std::atomic<size_t> write_off{0}; // end of the last complete record
+    size_t synced_off = 0;            // flusher only
+    uint64_t last_seq = 0;
+  };
+
+  std::unique_ptr<Segment> create_segment(uint32_t index);
+  void close_segment(Segment &seg);
+  void roll_over();
+  void sync_segment(Segment &seg);
+  void persist_mark(uint64_t mark);
+  void retire(const std::string &path, size_t size);
+  bool sync_dir();
+  void flusher_loop();
+  std::string segment_path(uint32_t index) const;
+
+  std::string dir;
+  size_t segment_bytes;
+  int fsync_ms;
+  size_t keep_bytes;
+
+  std::unique_ptr<Segment> active;
+  std::mutex seg_mutex; // guards active swap, sealed and spare
+  std::vector<std::unique_ptr<Segment>> sealed; // full, oldest first
+  std::unique_ptr<Segment> spare;
+  uint32_t next_index = 1;
+  std::vector<std::pair<std::string, size_t>> old_segments; // from replay()
+  // committed segments kept for an in-memory DB, oldest first
+  std::deque<std::pair<std::string, size_t>> kept;
+  size_t kept_bytes = 0;
+
+  uint64_t next_seq = 1; // reader thread once started
+  std::atomic<uint64_t> commit_mark{0};
+  uint64_t persisted_mark = 0;
+  std::atomic<bool> running{false};
+  std::thread flusher;
+
+  std::atomic<uint64_t> appended_count{0};
+  std::atomic<uint64_t> sync_count{0};
+};
+
+#endif // EVENT_JOURNAL_H
@@ -0,0 +1,128 @@
+#ifndef FEDERATION_H
+#define FEDERATION_H
+
+#include "deauth_event.h"
+#include "ingest.h"
+#include "sensor_health.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Multi-node federation: every Pi (node) streams its stamped events to one
+// aggregator, which runs the usual ingest/analysis over all of them.
+//
+// Wire format, over TCP, little endian like everything else here:
+//   frame   = magic "DDF1" | type u8 | 3 pad | payload length u32 | payload
+//   HELLO   = node_id u32 | session u64 (node start time, us)
+//   BATCH   = seq u64 | encoded events
+//   ACK     = seq u64, everything up to seq is stored
+//
+// Batches are encoded per batch, no shared state, so any of them can be
+// resent after a reconnect: a MAC dictionary, then per event the two MAC
+// indexes, rssi, raw variance, frame count and timestamp delta as varints.
+// A typical event goes from 29 bytes to about 10.
+
+enum class FrameType : uint8_t { Hello = 1, Batch = 2, Ack = 3 };
+
+static const size_t frame_header_size = 12;
+static const uint32_t max_frame_payload = 8 * 1024 * 1024;
+
+void encode_batch(const wifi_deauth_event_t *events, size_t count,
+                  std::string &out);
+bool decode_batch(const uint8_t *data, size_t len,
+                  std::vector<wifi_deauth_event_t> &out);
+
+// header + payload in one string
+std::string make_frame(FrameType type, const std::string &payload);
+
+// Node side. The reader hands every stamped event to send(), which never
+// blocks: it only appends, and a full batch is moved (not encoded) under the
+// lock. A sender thread encodes and ships sealed batches and keeps them
+// until the aggregator acks them. While the aggregator is unreachable
+// batches pile up to backlog_events, then the oldest are dropped.
+class Uplink {
+public:
+  Uplink(const std::string &host, int port, uint32_t node_id,
+         size_t backlog_events);
+  ~Uplink();
+
+  bool start();
+  void stop();
+
+  void send(const wifi_deauth_event_t &event);
+
+  uint64_t acked_events() const { return acked; }
+  uint64_t dropped_events() const { return dropped; }
+  size_t backlog() const;
+  bool connected() const { return fd >= 0; }
+
+private:
+  struct Batch {
+    uint64_t seq;
+    size_t events;
+    std::shared_ptr<const std::string> frame;
+  };
+
+  void run();
+  bool pump(bool flush);
+  bool connect_upstream();
+  void disconnect();
+  void seal_locked();
+  void trim_locked();
+  bool read_acks();
+
+  std::string host;
+  int port;
+  uint32_t node_id;
+  uint64_t session;
+  size_t max_backlog;
+
+  std::atomic<int> fd{-1};
+  std::atomic<bool> running{false};
+  std::thread sender;
+  std::string inbuf;
+
+  mutable std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<wifi_deauth_event_t> open; // batch being filled
+  int64_t open_since = 0;
+  // sealed but not encoded yet, oldest first
+  std::deque<std::vector<wifi_deauth_event_t>> unencoded;
+  size_t unencoded_events = 0;
+  std::vector<std::vector<wifi_deauth_event_t>> spare; // recycled buffers
+  std::deque<Batch> pending; // encoded, not acked yet
+  size_t pending_events = 0;
+  size_t next_unsent = 0; // index into pending for this connection
+  uint64_t next_seq = 1;  // sender thread only
+
+  std::atomic<uint64_t> acked{0};
+  std::atomic<uint64_t> dropped{0};
+};
+
+struct FederationStats {
+  std::atomic<uint64_t> nodes{0}; // connected right now
+  std::atomic<uint64_t> batches{0};
+  std::atomic<uint64_t> events{0};
+  std::atomic<uint64_t> duplicate_batches{0}; // resent after a lost ack
+  std::atomic<uint64_t> duplicate_events{0};  // same frame via two gateways
+  std::atomic<uint64_t> bad_frames{0};
+};
+
+// Aggregator side, listening on all interfaces. Returns -1 on failure.
+int open_aggregator_socket(int port);
+
+// Producer thread in --aggregate mode, instead of read_events. One thread
+// polls every node connection, so stamping/journal/queue still have a
+// single writer. The caller closes listen_fd after joining.
+void aggregate_events(int listen_fd, IngestQueue *queue, EventJournal *journal,
+                      SensorHealth *health, AlertEngine *alerts,
+                      FederationStats *stats);
+
+#endif // FEDERATION_H
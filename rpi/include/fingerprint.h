@@ -0,0 +1,56 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// RSSI fingerprint localization.
+//
+// A radio map is a grid of cells, each holding the RSSI every sensor is
+// expected to report for a transmitter in that cell. It comes either from
+// calibration walks (CSV of x,y,sensor_mac,rssi samples) or from the same
+// path-loss model rssi_to_distance uses. A live RSSI vector is matched
+// against every cell and the k nearest cells (euclidean distance in dBm
+// space, missing sensors ignored) are averaged, weighted by 1/distance.
+//
+// The map is stored structure-of-arrays: one contiguous, padded column of
+// RSSI per sensor. The distance pass walks one column at a time with NEON
+// (aarch64) or SSE2 (x86-64), so a 10k cell map is a few tens of thousands
+// of vector ops per fix.
+class RadioMap {
+public:
+  // Grid over [min_x, max_x] x [min_y, max_y] from the path-loss model
+  void build_from_model(
+      const std::map<std::string, std::pair<double, double>> &sensors,
+      double min_x, double min_y, double max_x, double max_y,
+      double cell_size);
+  // Calibration samples, one "x,y,sensor_mac,rssi" per line. Samples are
+  // snapped to a cell_size grid and averaged per cell and sensor; holes are
+  // filled from the model.
+  bool load_csv(const std::string &path,
+                const std::map<std::string, std::pair<double, double>> &sensors,
+                double cell_size);
+
+  size_t cells() const { return num_cells; }
+  const std::vector<std::string> &sensor_macs() const { return macs; }
+  int sensor_index(const std::string &mac) const;
+
+  // live[i] is the RSSI for sensor_macs()[i], NaN if that sensor has
+  // nothing. Needs at least two sensors.
+  bool locate(const std::vector<float> &live, int k, double &out_x,
+              double &out_y) const;
+
+private:
+  void resize(size_t cells);
+
+  std::vector<std::string> macs;
+  size_t num_cells = 0;
+  size_t stride = 0; // num_cells rounded up to the vector width
+  std::vector<float> cell_x, cell_y;
+  std::vector<float> rssi; // sensor-major: rssi[s * stride + cell]
+};
+
+#endif // FINGERPRINT_H
@@ -0,0 +1,141 @@
+#ifndef INCIDENTS_H
+#define INCIDENTS_H
+
+#include "deauth_event.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace duckdb {
+class Connection;
+class DuckDB;
+} // namespace duckdb
+
+// Interval index over [start, end]: an AVL tree ordered by start, every node
+// also keeps the largest end in its subtree so whole subtrees that end
+// before a query window are skipped. Insert, erase_min and an overlap query
+// returning k hits are all O(log n + k). Nodes live in one vector and are
+// recycled, so a full tree doesn't allocate.
+class IntervalTree {
+public:
+  void insert(int64_t start, int64_t end, int64_t id);
+  // drop the interval that starts first, false if empty
+  bool erase_min(int64_t &id);
+  // ids overlapping [from, to], latest start first, at most limit
+  void overlapping(int64_t from, int64_t to, size_t limit,
+                   std::vector<int64_t> &out) const;
+  size_t size() const { return count; }
+
+private:
+  struct Node {
+    int64_t start, end, max_end, id;
+    int left, right, height;
+  };
+
+  int height(int n) const { return n < 0 ? 0 : nodes[n].height; }
+  void update(int n);
+  int rotate_left(int n);
+  int rotate_right(int n);
+  int rebalance(int n);
+  int insert_at(int n, int slot);
+  int erase_min_at(int n, int &removed);
+  void collect(int n, int64_t from, int64_t to, size_t limit,
+               std::vector<int64_t> &out) const;
+
+  std::vector<Node> nodes;
+  std::vector<int> free_slots;
+  int root = -1;
+  size_t count = 0;
+};
+
+struct IncidentSensor {
+  uint64_t key = 0; // MAC as a 48-bit number
+  char mac[18] = {};
+  uint64_t events = 0;
+  uint64_t frames = 0;
+  int64_t second = 0; // 1 s bucket the rate is being counted in
+  uint64_t second_frames = 0;
+};
+
+struct IncidentPoint {
+  int64_t ts;
+  double x, y;
+};
+
+// One attack as seen by every sensor that heard it
+struct Incident {
+  int64_t id = 0;
+  std::string attack_mac;
+  uint64_t attacker = 0; // MAC as a 48-bit key
+  int64_t start = 0;     // first and last event, us
+  int64_t end = 0;
+  bool open = true;
+  bool dirty = true; // changed since it was last written to DB
+  uint64_t events = 0;
+  // the same frames reach several sensors, so this is the best sensor's
+  // count and peak rate, not a sum
+  uint64_t frames = 0;
+  double peak_rate = 0; // frames/s
+  double confidence = 0;
+  std::vector<IncidentSensor> sensors;
+  std::vector<IncidentPoint> track; // position fixes, thinned past 64
+};
+
+// Streaming correlator: rows from all sensors are grouped by attacker into
+// incidents. An incident stays open until its attacker has been quiet for
+// gap_us, then it is closed and moves into the interval index. Only
+// max_closed closed incidents are kept in memory once written (take_dirty),
+// DB has all of them.
+//
+// on_event runs on the inserter, on_position on the analysis loop and
+// query on API workers, everything is behind one mutex.
+class IncidentCorrelator {
+public:
+  IncidentCorrelator(int64_t gap_us, size_t max_closed);
+
+  void on_event(const wifi_deauth_event_t &event);
+  void on_position(const std::string &attack_mac, double x, double y,
+                   int64_t ts);
+  // close incidents whose attacker went quiet before now - gap
+  void close_idle(int64_t now);
+  void close_all(); // shutdown
+
+  // incidents that changed since the last call, for the DB writer
+  void take_dirty(std::vector<Incident> &out);
+  // open and closed incidents overlapping [from, to], latest start first;
+  // empty attack_mac = any attacker
+  std::vector<Incident> query(int64_t from, int64_t to,
+                              const std::string &attack_mac,
+                              size_t limit) const;
+
+  void set_next_id(int64_t id);
+  size_t open_count() const;
+  uint64_t closed_count() const;
+
+private:
+  void close(Incident &inc);
+  void evict();
+
+  int64_t gap_us;
+  size_t max_closed;
+  int64_t next_id = 1;
+  uint64_t closed_total = 0;
+
+  mutable std::mutex mtx;
+  std::unordered_map<uint64_t, Incident> open_by_attacker;
+  std::unordered_map<int64_t, Incident> closed;
+  IntervalTree index; // closed only, open ones are still growing
+  std::vector<int64_t> closed_dirty;
+};
+
+// Create the incidents table, close rows a crash left open and continue
+// the id sequence
+bool init_incidents(duckdb::DuckDB *db, IncidentCorrelator *incidents);
+// Close quiet incidents (event time) and upsert everything that changed
+void write_incidents(duckdb::Connection &con, IncidentCorrelator *incidents,
+                     int64_t now);
+
+#endif // INCIDENTS_H
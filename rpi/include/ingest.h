@@ -0,0 +1,162 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include "alert_rules.h"
+#include "deauth_event.h"
+#include "event_journal.h"
+#include "sensor_health.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <duckdb.hpp>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Defined in main.cpp, cleared on SIGINT
+extern std::atomic<bool> keep_running;
+
+// What the reader does when the queue to the inserter fills up
+enum class OverloadPolicy {
+  Block,      // stop reading the UART until there is room (kernel tty
+              // buffer overruns instead, nothing is counted here)
+  DropOldest, // overwrite the oldest queued event
+  Sample      // past the sampling threshold keep 1 of every N events per
+              // attacker, but always the first and last event of an attack
+};
+
+bool parse_overload_policy(const std::string &name, OverloadPolicy &out);
+const char *overload_policy_name(OverloadPolicy policy);
+
+struct IngestConfig {
+  size_t queue_capacity = 65536;
+  size_t bucket_capacity = 200000; // max events held for re-ordering
+  OverloadPolicy policy = OverloadPolicy::Sample;
+  double sample_above = 0.5; // queue fill ratio where sampling starts
+  int sample_every = 10;
+  int64_t attack_gap_us = 5000000; // silence that ends an attack
+};
+
+// Load shedding counters, everything is cumulative
+struct IngestStats {
+  std::atomic<uint64_t> received{0};
+  std::atomic<uint64_t> enqueued{0};
+  std::atomic<uint64_t> dropped_oldest{0}; // evicted from a full queue
+  std::atomic<uint64_t> sampled_out{0};    // skipped by per-attacker sampling
+  std::atomic<uint64_t> edges_kept{0};     // attack first/last kept by Sample
+  std::atomic<uint64_t> blocked{0};        // pushes that had to wait (Block)
+  std::atomic<uint64_t> early_flushes{0};  // buckets flushed before quantum
+  std::atomic<uint64_t> max_depth{0};
+  std::atomic<uint64_t> appended{0};
+};
+
+class IncidentCorrelator; // incidents.h
+class Uplink;             // federation.h
+struct ThreadStats;       // realtime.h
+
+// Bounded ring buffer between read_events and insert_events
+class IngestQueue {
+public:
+  explicit IngestQueue(const IngestConfig &config);
+
+  // seq is the event's journal sequence number (0 without a journal)
+  void push(const wifi_deauth_event_t &event, uint64_t seq);
+  // false once stopped and drained, or if nothing came in for timeout_us
+  // (-1 = wait until something does). queued_at, if set, gets when the event
+  // went into the queue (our clock).
+  bool pop(wifi_deauth_event_t &event, uint64_t &seq, int64_t timeout_us = -1,
+           int64_t *queued_at = nullptr);
+  // Release held "last" events of attacks that have gone quiet
+  void flush_edges(int64_t now);
+  void wake_all();
+  size_t size();
+  // Lowest journal sequence still queued or held back, UINT64_MAX if none
+  uint64_t oldest_seq();
+
+  const IngestConfig &config() const { return cfg; }
+  IngestStats stats;
+
+private:
+  struct AttackState {
+    int64_t last_ts = 0;
+    uint32_t seen = 0;
+    bool has_held = false;
+    wifi_deauth_event_t held;
+    uint64_t held_seq = 0;
+  };
+
+  void push_locked(const wifi_deauth_event_t &event, uint64_t seq,
+                   bool must_keep);
+
+  IngestConfig cfg;
+  std::vector<wifi_deauth_event_t> ring;
+  std::vector<uint64_t> seqs;      // parallel to ring
+  std::vector<int64_t> queued_at; // parallel to ring
+  size_t head = 0;
+  size_t count = 0;
+  std::mutex mtx;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+  std::unordered_map<uint64_t, AttackState> attacks; // Sample only
+};
+
+// Order a re-ordering bucket by timestamp
+void sort_bucket(std::vector<SequencedEvent> &bucket);
+
+// Reorder stage of insert_events: events are held for one quantum (2 s),
+// then the bucket is sorted and handed to the sink. A flood closes it early
+// at bucket_capacity. There is only ever one open bucket and its buffer is
+// reused, so once it has grown to the usual bucket size nothing allocates.
+class ReorderBuffer {
+public:
+  using Sink = std::function<void(std::vector<SequencedEvent> &bucket)>;
+
+  ReorderBuffer(size_t bucket_capacity, IngestStats &stats, Sink sink);
+
+  // true if this event closed the previous bucket
+  bool add(const wifi_deauth_event_t &event, uint64_t seq);
+  // hand over what is left (shutdown), true if there was anything
+  bool flush();
+  // flush a bucket that sat out its quantum with no newer event to close
+  // it (traffic stopped), true if it did
+  bool flush_idle(int64_t now);
+
+private:
+  size_t capacity;
+  IngestStats &stats;
+  Sink sink;
+  std::vector<SequencedEvent> bucket;
+  int64_t bucket_start = 0;
+};
+
+// Put everything the journal has past its commit mark back into DB, skipping
+// rows whose seq already made it before the crash
+bool replay_journal(duckdb::DuckDB *db, EventJournal *journal,
+                    std::atomic<int64_t> *watermark);
+
+// Stamp, journal and queue one raw event, from the one producer thread
+// (serial reader or aggregator). source_ts > 0 is kept as the stamp unless it
+// is in the future, so federated events keep their node's clock even when
+// they arrive late or interleaved with other nodes.
+// Heartbeats only go to health and alerts (either may be null) and return
+// false.
+bool ingest_event(wifi_deauth_event_t &event, int64_t source_ts,
+                  IngestQueue *queue, EventJournal *journal,
+                  SensorHealth *health, AlertEngine *alerts);
+
+// journal, health, alerts and uplink may be null, record_fd < 0 disables
+// recording.
+// If fd is not a tty (a recorded capture) the reader stops the program at EOF.
+// incidents and rt may be null; rt collects latency and context switches for
+// --realtime.
+void read_events(int fd, IngestQueue *queue, EventJournal *journal,
+                 int record_fd, SensorHealth *health, AlertEngine *alerts,
+                 Uplink *uplink, ThreadStats *rt);
+void insert_events(duckdb::DuckDB *db, IngestQueue *queue, AlertEngine *alerts,
+                   IncidentCorrelator *incidents, EventJournal *journal,
+                   std::atomic<int64_t> *watermark, ThreadStats *rt);
+
+#endif // INGEST_H
@@ -0,0 +1,37 @@
+#ifndef LOCALIZATION_H
+#define LOCALIZATION_H
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// sensor mac -> (x, y) in meters
+extern std::map<std::string, std::pair<double, double>> sensor_positions;
+
+// Replace sensor_positions from a map file, one "MAC x y" per line (commas
+// work too, # starts a comment). Every node of a federation loads the same
+// file so positions share one coordinate frame.
+bool load_sensor_positions(const std::string &path);
+
+std::tuple<double, double> trilaterate(double x1, double y1, double r1,
+                                       double x2, double y2, double r2,
+                                       double x3, double y3, double r3);
+
+bool multilateration_least_squares(
+    const std::vector<std::pair<double, double>> &sensors,
+    const std::vector<double> &ranges, double &out_x, double &out_y);
+
+// Log-distance path loss calibration shared by rssi_to_distance and the
+// simulator. RSSI at 1 meter, sensor 1: -41, sensor 2: -39, sensor 3: -41
+static const double rssi_at_1m = -40;
+static const double path_loss_exponent = 3.0; // this should stay the same
+
+double rssi_to_distance(int rssi);
+double distance_to_rssi(double meters);
+double rssi_to_distance_s1(int rssi);
+double rssi_to_distance_s2(int rssi);
+double rssi_to_distance_s3(int rssi);
+
+#endif // LOCALIZATION_H
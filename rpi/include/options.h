@@ -0,0 +1,77 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "ingest.h"
+#include "realtime.h"
+#include <cstdint>
+#include <string>
+
+// Runtime configuration, filled from the command line
+struct Options {
+  std::string port = "/dev/serial0"; // or a recorded capture file
+  std::string record_path;          // save raw UART events for replay
+
+  // DuckDB file, empty = in-memory (lost on exit unless journaled, then the
+  // journal keeps its newest journal_keep_bytes and replays them on start)
+  std::string db_path;
+
+  // Raw event journal directory, empty = off
+  std::string journal_dir;
+  size_t journal_segment_bytes = 4 * 1024 * 1024;
+  int journal_fsync_ms = 100;
+  size_t journal_keep_bytes = 256 * 1024 * 1024; // without --db only
+
+  // Local query API (HTTP/JSON on 127.0.0.1), 0 disables it
+  int api_port = 8080;
+  int api_workers = 2;
+  int api_backlog = 64; // accepted connections waiting for a worker
+
+  // Reader connections for analytical queries (ingest has its own writer)
+  int readers = 2;
+  int max_queued_queries = 128;
+  int api_timeout_ms = 2000;
+  int analysis_timeout_ms = 5000;
+
+  // Queue/reorder limits and overload policy
+  IngestConfig ingest;
+
+  // Alert rules file, empty = no alerting
+  std::string rules_path;
+
+  // Position engine: "ls" (multilateration) or "fingerprint" (radio map)
+  std::string locator = "ls";
+  std::string radio_map_path; // calibration CSV, empty = path-loss model grid
+  double map_cell = 0.05;     // radio map grid spacing, meters
+  int knn_k = 4;
+
+  // Per-attacker localization window bounds
+  int window_min_ms = 500;
+  int window_max_ms = 16000;
+
+  // Sensor liveness (heartbeats come every 5 s)
+  int sensor_stale_s = 12;
+  int sensor_offline_s = 30;
+
+  // Sensor map file (MAC x y per line), empty = built-in three sensors
+  std::string sensors_path;
+
+  // Federation: stream events to an aggregator, or be one (then there is
+  // no serial port, nodes are the input)
+  std::string upstream_host;
+  int upstream_port = 0;
+  uint32_t node_id = 0;
+  size_t upstream_backlog = 1000000; // events kept while disconnected
+  int aggregate_port = 0;
+
+  // Incidents: an attacker quiet this long starts a new one next time
+  int incident_gap_s = 30;
+  size_t incident_memory = 100000; // closed incidents kept for the API
+
+  // Pinning, SCHED_FIFO reader and locked memory, off unless --realtime
+  RealtimeConfig realtime;
+};
+
+// Returns false (after printing usage) on bad arguments or --help
+bool parse_options(int argc, char **argv, Options &opts);
+
+#endif // OPTIONS_H
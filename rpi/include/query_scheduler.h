@@ -0,0 +1,104 @@
+#ifndef QUERY_SCHEDULER_H
+#define QUERY_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <duckdb.hpp>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Lower value runs first
+enum class QueryPriority { Interactive = 0, Analysis = 1, Background = 2 };
+
+struct ScheduledResult {
+  std::unique_ptr<duckdb::MaterializedQueryResult> result; // null on error
+  bool timed_out = false;
+  std::string error;
+
+  bool ok() const { return result != nullptr && error.empty(); }
+};
+
+// Runs analytical queries on a pool of reader connections, separate from the
+// ingest writer connection. Every job carries a priority and a timeout. A
+// watchdog fails jobs still queued at their deadline, even while every
+// reader is busy, and interrupts running ones through Connection::Interrupt.
+class QueryScheduler {
+public:
+  QueryScheduler(duckdb::DuckDB &db, int readers, size_t max_queued);
+  ~QueryScheduler();
+
+  void start();
+  void stop();
+
+  // Single statement, blocks the caller until it finishes or times out
+  ScheduledResult query(const std::string &sql, QueryPriority prio,
+                        int timeout_ms);
+
+  // Several statements on one reader connection. With snapshot set, fn runs
+  // inside a transaction so all of its queries see the same database state
+  // even while ingest keeps appending.
+  bool run(QueryPriority prio, int timeout_ms, bool snapshot,
+           const std::function<void(duckdb::Connection &)> &fn,
+           std::string &error);
+
+  uint64_t timeouts() const { return timed_out_jobs.load(); }
+  uint64_t rejections() const { return rejected_jobs.load(); }
+
+private:
+  struct Job {
+    QueryPriority prio;
+    uint64_t seq;
+    int64_t deadline_us;
+    bool snapshot;
+    std::function<void(duckdb::Connection &)> fn;
+    std::promise<std::string> done; // error text, empty on success
+  };
+  struct JobOrder {
+    bool operator()(const std::shared_ptr<Job> &a,
+                    const std::shared_ptr<Job> &b) const {
+      if (a->prio != b->prio)
+        return a->prio > b->prio;
+      return a->seq > b->seq; // FIFO within a priority
+    }
+  };
+  // What a reader is running right now, for the watchdog. The watchdog
+  // checks and interrupts under mtx, and the reader only switches jobs
+  // under it, so an interrupt always hits the job it was meant for.
+  struct Slot {
+    std::unique_ptr<duckdb::Connection> con;
+    std::mutex mtx;
+    int64_t deadline_us = 0; // 0 = idle
+    bool interrupted = false;
+  };
+
+  std::string submit(QueryPriority prio, int timeout_ms, bool snapshot,
+                     std::function<void(duckdb::Connection &)> fn);
+  void reader_loop(Slot *slot);
+  void watchdog_loop();
+
+  duckdb::DuckDB &db;
+  size_t max_queued;
+  std::vector<std::unique_ptr<Slot>> slots;
+  std::vector<std::thread> threads;
+  std::thread watchdog;
+  std::atomic<bool> running{false};
+
+  std::priority_queue<std::shared_ptr<Job>, std::vector<std::shared_ptr<Job>>,
+                      JobOrder>
+      jobs;
+  uint64_t next_seq = 0;
+  std::mutex jobs_mutex;
+  std::condition_variable jobs_cv;
+
+  std::atomic<uint64_t> timed_out_jobs{0};
+  std::atomic<uint64_t> rejected_jobs{0};
+};
+
+#endif // QUERY_SCHEDULER_H
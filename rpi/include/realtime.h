@@ -0,0 +1,94 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Realtime mode for the ingest threads: the reader, inserter and analysis
+// threads can each be pinned to a core, the reader runs SCHED_FIFO and all
+// memory is locked so a page fault can't stall the UART. Everything that
+// needs privileges (CAP_SYS_NICE, CAP_IPC_LOCK or a big enough memlock
+// limit) is tried once and skipped with a warning when it isn't allowed.
+struct RealtimeConfig {
+  bool enabled = false;
+  int reader_cpu = -1; // -1 = not pinned
+  int inserter_cpu = -1;
+  int analysis_cpu = -1;
+  int reader_priority = 50; // SCHED_FIFO, 1..99
+};
+
+bool parse_realtime_cpus(const std::string &list, RealtimeConfig &out);
+
+// log2 buckets of microseconds: bucket 0 is < 1 us, bucket i is
+// [2^(i-1), 2^i). One thread records, any thread may read.
+class LatencyHistogram {
+public:
+  static const int buckets = 32;
+
+  void record(int64_t us);
+  uint64_t count() const;
+  int64_t max() const { return max_us.load(std::memory_order_relaxed); }
+  // upper bound of the bucket holding the q-quantile, 0 when empty
+  int64_t percentile(double q) const;
+
+private:
+  std::atomic<uint64_t> hist[buckets] = {};
+  std::atomic<int64_t> max_us{0};
+};
+
+// What one realtime thread is doing, for the [rt] telemetry line
+struct ThreadStats {
+  ThreadStats(const char *name, const char *measures)
+      : name(name), measures(measures) {}
+
+  const char *name;
+  const char *measures; // what latency holds, printed with it
+  // reader: how late it noticed a WakeupProbe expiry, inserter: queued to
+  // popped, analysis: how late its sleep woke up
+  LatencyHistogram latency;
+  std::atomic<int> cpu{-1}; // where it is pinned
+  std::atomic<bool> fifo{false};
+  std::atomic<uint64_t> voluntary_switches{0};
+  std::atomic<uint64_t> involuntary_switches{0};
+
+  // getrusage(RUSAGE_THREAD), from the thread itself, at most once a second
+  void sample_rusage(int64_t now);
+  std::string report() const;
+
+private:
+  int64_t last_sample = 0;
+};
+
+struct RealtimeStats {
+  ThreadStats reader{"reader", "wakeup"};
+  ThreadStats inserter{"inserter", "queue_wait"};
+  ThreadStats analysis{"analysis", "sleep_late"};
+};
+
+// A periodic timer the reader polls next to the UART. The gap between an
+// expiry and the reader seeing it is its scheduling latency, the thing
+// SCHED_FIFO and pinning are there to keep small.
+struct WakeupProbe {
+  int fd = -1; // timerfd, -1 = not running
+  int64_t period_ns = 0;
+  int64_t next_ns = 0; // next expiry, CLOCK_MONOTONIC
+
+  ~WakeupProbe();
+  bool start(int64_t period_us = 10000);
+  // fd polled readable: record how late the newest expiry was noticed
+  void fired(LatencyHistogram &hist);
+};
+
+// mlockall, plus malloc settings that keep freed memory mapped once it is
+// locked; call before starting threads. false (with a warning) when not
+// permitted.
+bool lock_memory();
+
+// Run at the top of a realtime thread: pin to cpu (-1 = leave it), switch
+// to SCHED_FIFO at fifo_priority (0 = leave it) and touch the stack so it
+// is resident before the first event.
+void enter_realtime(ThreadStats &stats, int cpu, int fifo_priority);
+
+#endif // REALTIME_H
@@ -0,0 +1,56 @@
+#ifndef SENSOR_HEALTH_H
+#define SENSOR_HEALTH_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Online: heard from (event or heartbeat) within stale_us.
+// Stale: missed a couple of heartbeats, still within offline_us.
+// Offline: nothing for longer than that, or never heard from at all.
+enum class SensorState { Online, Stale, Offline };
+const char *sensor_state_name(SensorState state);
+
+struct SensorStatus {
+  std::string sensor_mac;
+  SensorState state;
+  int64_t last_seen; // newest event or heartbeat (us), 0 = never
+  int64_t last_event;
+  int64_t last_heartbeat;
+  uint64_t events;
+  uint64_t heartbeats;
+};
+
+// Per-sensor liveness. Fed by the reader thread, read by the analysis loop
+// and the API. Every sensor in sensor_positions is known from the start, so
+// one that never reports shows up as offline.
+class SensorHealth {
+public:
+  SensorHealth(int64_t stale_us, int64_t offline_us);
+
+  void on_event(const uint8_t mac[6], int64_t ts);
+  void on_heartbeat(const uint8_t mac[6], int64_t ts);
+
+  // Fills out sorted by MAC, reusing its strings, so a buffer kept by the
+  // caller stops allocating once it has seen every sensor
+  void report(int64_t now, std::vector<SensorStatus> &out) const;
+
+private:
+  struct Entry {
+    std::string mac;
+    int64_t last_event = 0;
+    int64_t last_heartbeat = 0;
+    uint64_t events = 0;
+    uint64_t heartbeats = 0;
+  };
+  Entry &entry(const uint8_t mac[6]);
+
+  int64_t stale_us;
+  int64_t offline_us;
+  mutable std::mutex mtx;
+  std::unordered_map<uint64_t, Entry> sensors;
+};
+
+#endif // SENSOR_HEALTH_H
@@ -0,0 +1,31 @@
+#!/bin/bash
+# Profile-guided + LTO release build of deauthdetect.
+#
+#   rpi/scripts/pgo_build.sh capture.bin
+#
+# capture.bin is a recorded workload (deauthdetect --record capture.bin, or
+# the output of the simulator). Run from the repository root; the optimized
+# binary ends up in rpi/build-pgo/deauthdetect.
+
+set -e
+
+CAPTURE=${1:?usage: $0 capture.bin}
+BUILD=rpi/build-pgo
+PROFILES=$PWD/$BUILD/pgo-data
+
+rm -rf "$PROFILES"
+
+# 1. instrumented build
+cmake -S rpi -B "$BUILD" -DCMAKE_BUILD_TYPE=Release -DDEAUTH_PGO=GENERATE \
+  -DDEAUTH_PGO_DIR="$PROFILES"
+cmake --build "$BUILD" -j"$(nproc)"
+
+# 2. training: the recorded workload end to end, plus the hot path benchmarks
+"$BUILD"/deauthdetect --port "$CAPTURE" --api-port 0 > /dev/null
+"$BUILD"/deauthdetect_bench --min-time-ms 50 > /dev/null
+
+# 3. same build dir, so object paths match the recorded profiles
+cmake -S rpi -B "$BUILD" -DDEAUTH_PGO=USE
+cmake --build "$BUILD" -j"$(nproc)" --clean-first
+
+echo "PGO build ready: $BUILD/deauthdetect"
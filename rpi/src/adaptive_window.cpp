@@ -0,0 +1,94 @@
+#include "../include/adaptive_window.h"
+#include <algorithm>
+using namespace std;
+
+// events per sensor that count as "dense" for shrinking
+static const int64_t dense_events = 5;
+
+AdaptiveWindow::AdaptiveWindow(int64_t min_us, int64_t max_us)
+    : min_us(max<int64_t>(min_us, 2000)),
+      max_us(max(max_us, this->min_us)), slot_us(this->min_us / 2) {}
+
+// per-sensor sums over the slots overlapping (ts_max - window, ts_max] into
+// out[0, n), returns n. Entries past n are left for reuse.
+size_t AdaptiveWindow::sum_window(const WindowSlot *slots, size_t count,
+                                  int64_t from, vector<SensorAverage> &out) {
+  size_t n = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const WindowSlot &s = slots[i];
+    if (s.slot + slot_us <= from || s.events <= 0)
+      continue;
+    size_t j = 0;
+    while (j < n && out[j].sensor_mac != s.sensor_mac)
+      ++j;
+    if (j == n) {
+      if (n == out.size())
+        out.emplace_back();
+      if (n == rssi.size()) {
+        rssi.push_back(0);
+        variance.push_back(0);
+      }
+      out[n].sensor_mac.assign(s.sensor_mac);
+      out[n].frame_count = 0;
+      out[n].events = 0;
+      rssi[n] = 0;
+      variance[n] = 0;
+      n++;
+    }
+    rssi[j] += s.rssi_sum;
+    variance[j] += s.variance_sum;
+    out[j].frame_count += (int)s.frames;
+    out[j].events += (int)s.events;
+  }
+  for (size_t j = 0; j < n; ++j) {
+    out[j].avg_rssi = (float)(rssi[j] / out[j].events);
+    out[j].avg_variance = (float)(variance[j] / out[j].events);
+  }
+  return n;
+}
+
+int64_t AdaptiveWindow::select(const string &attacker, const WindowSlot *slots,
+                               size_t count, int64_t ts_max, size_t want,
+                               vector<SensorAverage> &out, size_t &used) {
+  auto it = state.find(attacker);
+  if (it == state.end())
+    it = state.emplace(attacker, State{min_us, ts_max}).first;
+  State &st = it->second;
+  st.last_ts = ts_max;
+
+  // widening can't find sensors that aren't in the max window at all
+  want = min(want, sum_window(slots, count, ts_max - max_us, out));
+
+  int64_t window = st.window_us;
+  used = sum_window(slots, count, ts_max - window, out);
+  while (used < want && window < max_us) {
+    window = min(window * 2, max_us);
+    used = sum_window(slots, count, ts_max - window, out);
+  }
+
+  // shrink if the newer half alone would do with plenty of data per sensor
+  if (window > min_us && window == st.window_us) {
+    int64_t half = max(window / 2, min_us);
+    size_t n = sum_window(slots, count, ts_max - half, newer);
+    bool dense = n >= max<size_t>(want, 1);
+    for (size_t j = 0; j < n; ++j)
+      dense = dense && newer[j].events >= dense_events;
+    if (dense) {
+      window = half;
+      out.swap(newer);
+      used = n;
+    }
+  }
+
+  st.window_us = window;
+  return window;
+}
+
+void AdaptiveWindow::prune(int64_t ts_max) {
+  for (auto it = state.begin(); it != state.end();) {
+    if (it->second.last_ts < ts_max - max_us)
+      it = state.erase(it);
+    else
+      ++it;
+  }
+}
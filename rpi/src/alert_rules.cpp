@@ -0,0 +1,438 @@
+#include "../include/alert_rules.h"
+#include "../include/localization.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+using namespace std;
+
+static const size_t max_outbox = 1024;
+static const int64_t bucket_us = 100000; // RateWindow granularity
+static const int64_t rate_idle_us = 10000000; // forget idle rate windows
+
+// ray casting, polygon is closed implicitly
+static bool point_in_polygon(const vector<pair<double, double>> &poly,
+                             double x, double y) {
+  bool inside = false;
+  for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++) {
+    double xi = poly[i].first, yi = poly[i].second;
+    double xj = poly[j].first, yj = poly[j].second;
+    if (((yi > y) != (yj > y)) &&
+        (x < (xj - xi) * (y - yi) / (yj - yi) + xi))
+      inside = !inside;
+  }
+  return inside;
+}
+
+static bool parse_mac(const string &s, uint8_t out[6]) {
+  unsigned int b[6];
+  if (sscanf(s.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3],
+             &b[4], &b[5]) != 6)
+    return false;
+  for (int i = 0; i < 6; ++i)
+    out[i] = (uint8_t)b[i];
+  return true;
+}
+
+void AlertEngine::RateWindow::add(int64_t ts, int64_t n) {
+  int64_t id = ts / bucket_us;
+  int idx = id % 10;
+  if (bucket_id[idx] != id) {
+    bucket_id[idx] = id;
+    frames[idx] = 0;
+  }
+  frames[idx] += n;
+}
+
+double AlertEngine::RateWindow::rate(int64_t ts) const {
+  int64_t id = ts / bucket_us;
+  int64_t sum = 0;
+  for (int i = 0; i < 10; ++i) {
+    int64_t age = id - bucket_id[i];
+    if (age >= 0 && age < 10)
+      sum += frames[i];
+  }
+  return (double)sum; // window is exactly 1 s
+}
+
+uint64_t AlertEngine::mac_key(const uint8_t mac[6]) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; ++i)
+    key = (key << 8) | mac[i];
+  return key;
+}
+
+string AlertEngine::key_to_mac(uint64_t key) {
+  uint8_t mac[6];
+  for (int i = 5; i >= 0; --i) {
+    mac[i] = key & 0xFF;
+    key >>= 8;
+  }
+  return bytes_to_mac(mac);
+}
+
+AlertEngine::AlertEngine() {}
+
+AlertEngine::~AlertEngine() { stop(); }
+
+bool AlertEngine::load(const string &path) {
+  ifstream in(path);
+  if (!in) {
+    cerr << "[alerts] Can't open rules file " << path << endl;
+    return false;
+  }
+
+  string line;
+  int lineno = 0;
+  while (getline(in, line)) {
+    ++lineno;
+    line = line.substr(0, line.find('#'));
+    istringstream words(line);
+    string kind, name;
+    if (!(words >> kind))
+      continue; // blank/comment
+    words >> name;
+
+    map<string, string> kv;
+    string word;
+    while (words >> word) {
+      size_t eq = word.find('=');
+      if (eq == string::npos) {
+        cerr << "[alerts] " << path << ":" << lineno << ": expected key=value, "
+             << "got '" << word << "'" << endl;
+        return false;
+      }
+      kv[word.substr(0, eq)] = word.substr(eq + 1);
+    }
+    auto num = [&](const string &k, double def) {
+      return kv.count(k) ? atof(kv[k].c_str()) : def;
+    };
+
+    if (kind == "sink") {
+      if (name == "file" && kv.count("path")) {
+        unique_ptr<FileAlertSink> sink(new FileAlertSink(kv["path"]));
+        if (!sink->ok())
+          return false;
+        sinks.push_back(std::move(sink));
+      } else if (name == "syslog") {
+        sinks.emplace_back(new SyslogAlertSink());
+      } else if (name == "webhook" && kv.count("port")) {
+        sinks.emplace_back(new WebhookAlertSink(
+            kv.count("host") ? kv["host"] : "127.0.0.1", atoi(kv["port"].c_str()),
+            kv.count("path") ? kv["path"] : "/"));
+      } else {
+        cerr << "[alerts] " << path << ":" << lineno << ": bad sink" << endl;
+        return false;
+      }
+      continue;
+    }
+
+    Rule rule;
+    rule.name = name;
+    rule.debounce_us = (int64_t)(num("debounce_s", 0) * 1e6);
+    if (kind == "rate" && kv.count("threshold")) {
+      rule.kind = Kind::Rate;
+      rule.threshold = num("threshold", 0);
+      rule.clear = num("clear", rule.threshold);
+    } else if (kind == "new_mac") {
+      rule.kind = Kind::NewMac;
+      rule.forget_us = (int64_t)(num("forget_s", 0) * 1e6);
+    } else if (kind == "zone" && kv.count("polygon")) {
+      rule.kind = Kind::Zone;
+      rule.exit_fixes = (int)num("exit_fixes", 2);
+      istringstream pts(kv["polygon"]);
+      string pt;
+      while (getline(pts, pt, ';')) {
+        double x, y;
+        if (sscanf(pt.c_str(), "%lf,%lf", &x, &y) == 2)
+          rule.polygon.push_back({x, y});
+      }
+      if (rule.polygon.size() < 3) {
+        cerr << "[alerts] " << path << ":" << lineno
+             << ": zone needs at least 3 points" << endl;
+        return false;
+      }
+    } else if (kind == "silent" && kv.count("timeout_s")) {
+      rule.kind = Kind::Silent;
+      rule.timeout_us = (int64_t)(num("timeout_s", 0) * 1e6);
+    } else {
+      cerr << "[alerts] " << path << ":" << lineno << ": bad rule '" << kind
+           << "'" << endl;
+      return false;
+    }
+    if (name.empty()) {
+      cerr << "[alerts] " << path << ":" << lineno << ": rule needs a name"
+           << endl;
+      return false;
+    }
+    rules.push_back(rule);
+  }
+
+  states.resize(rules.size());
+  zone_states.resize(rules.size());
+
+  // Sensors we expect to hear from count as seen at startup, so a sensor
+  // that never comes up still trips the silent rules
+  int64_t now = now_us();
+  for (const auto &kv : sensor_positions) {
+    uint8_t mac[6];
+    if (parse_mac(kv.first, mac))
+      sensor_seen[mac_key(mac)] = now;
+  }
+
+  cerr << "[alerts] Loaded " << rules.size() << " rules, " << sinks.size()
+       << " sinks from " << path << endl;
+  return true;
+}
+
+void AlertEngine::start() {
+  running = true;
+  ticker = thread(&AlertEngine::tick_loop, this);
+  dispatcher = thread(&AlertEngine::dispatch_loop, this);
+}
+
+void AlertEngine::stop() {
+  if (!running.exchange(false))
+    return;
+  outbox_cv.notify_all();
+  ticker.join();
+  dispatcher.join();
+}
+
+void AlertEngine::on_event(const wifi_deauth_event_t &event) {
+  if (rules.empty())
+    return;
+  uint64_t attacker = mac_key(event.attack_mac);
+  uint64_t sensor = mac_key(event.sensor_mac);
+  int64_t ts = event.timestamp;
+
+  lock_guard<mutex> lock(state_mutex);
+  sensor_heard(sensor, ts);
+  RateWindow &rw = rates[attacker][sensor];
+  rw.add(ts, event.frame_count);
+  double rate = rw.rate(ts);
+
+  for (size_t i = 0; i < rules.size(); ++i) {
+    const Rule &rule = rules[i];
+    switch (rule.kind) {
+    case Kind::Rate: {
+      KeyState &st = states[i][attacker];
+      st.last_seen = ts;
+      if (!st.active && rate > rule.threshold) {
+        st.owner = sensor;
+        raise(rule, st, key_to_mac(attacker), true,
+              to_string((int)rate) + " frames/s at sensor " +
+                  key_to_mac(sensor),
+              ts);
+      } else if (st.active && st.owner == sensor && rate < rule.clear) {
+        raise(rule, st, key_to_mac(attacker), false,
+              "rate back to " + to_string((int)rate) + " frames/s", ts);
+      }
+      break;
+    }
+    case Kind::NewMac: {
+      KeyState &st = states[i][attacker];
+      if (st.last_seen == 0 ||
+          (rule.forget_us > 0 && ts - st.last_seen > rule.forget_us))
+        raise(rule, st, key_to_mac(attacker), true,
+              "new attacker seen by sensor " + key_to_mac(sensor), ts);
+      st.active = false; // one-shot, nothing to resolve
+      st.last_seen = ts;
+      break;
+    }
+    case Kind::Silent: // sensor_heard
+    case Kind::Zone:    // on_position
+      break;
+    }
+  }
+}
+
+void AlertEngine::on_heartbeat(const uint8_t sensor_mac[6], int64_t ts) {
+  if (rules.empty())
+    return;
+  lock_guard<mutex> lock(state_mutex);
+  sensor_heard(mac_key(sensor_mac), ts);
+}
+
+// caller holds state_mutex
+void AlertEngine::sensor_heard(uint64_t sensor, int64_t ts) {
+  int64_t &seen = sensor_seen[sensor];
+  seen = max(seen, ts);
+  for (size_t i = 0; i < rules.size(); ++i) {
+    if (rules[i].kind != Kind::Silent)
+      continue;
+    auto it = states[i].find(sensor);
+    if (it != states[i].end() && it->second.active)
+      raise(rules[i], it->second, key_to_mac(sensor), false, "sensor is back",
+            ts);
+  }
+}
+
+void AlertEngine::on_position(const string &attack_mac, double x, double y,
+                              int64_t ts) {
+  if (rules.empty())
+    return;
+  lock_guard<mutex> lock(state_mutex);
+  for (size_t i = 0; i < rules.size(); ++i) {
+    const Rule &rule = rules[i];
+    if (rule.kind != Kind::Zone)
+      continue;
+    KeyState &st = zone_states[i][attack_mac];
+    st.last_seen = ts;
+    string key = attack_mac + "@" + rule.name;
+    char where[64];
+    snprintf(where, sizeof(where), "(%.2f, %.2f)", x, y);
+
+    if (point_in_polygon(rule.polygon, x, y)) {
+      st.outside = 0;
+      if (!st.active)
+        raise(rule, st, key, true, string("entered zone at ") + where, ts);
+    } else if (st.active && ++st.outside >= rule.exit_fixes) {
+      raise(rule, st, key, false, string("left zone at ") + where, ts);
+    }
+  }
+}
+
+// caller holds state_mutex
+void AlertEngine::raise(const Rule &rule, KeyState &st, const string &key,
+                        bool firing, const string &message, int64_t ts) {
+  static const char *kinds[] = {"rate", "new_mac", "zone", "silent"};
+
+  st.active = firing;
+  if (firing) {
+    // debounced: state flips but nobody is told, and neither will they be
+    // told when it resolves
+    st.suppressed = st.last_fired != 0 && ts - st.last_fired < rule.debounce_us;
+    if (st.suppressed)
+      return;
+    st.last_fired = ts;
+  } else if (st.suppressed) {
+    return;
+  }
+
+  Alert alert{rule.name, kinds[(int)rule.kind], key,
+              firing ? "firing" : "resolved", message, ts};
+  // CRITICAL SECTION
+  {
+    lock_guard<mutex> lock(outbox_mutex);
+    if (outbox.size() >= max_outbox) {
+      dropped_count++;
+      return;
+    }
+    outbox.push_back(std::move(alert));
+  }
+  if (firing)
+    fired_count++;
+  outbox_cv.notify_one();
+}
+
+// Time based conditions: silent sensors and rate alerts whose sensor went
+// quiet before it could report a low rate
+void AlertEngine::tick_loop() {
+  int64_t last_prune = now_us();
+  while (running) {
+    this_thread::sleep_for(chrono::milliseconds(200));
+    int64_t now = now_us();
+
+    lock_guard<mutex> lock(state_mutex);
+    for (size_t i = 0; i < rules.size(); ++i) {
+      const Rule &rule = rules[i];
+      if (rule.kind == Kind::Silent) {
+        for (const auto &kv : sensor_seen) {
+          KeyState &st = states[i][kv.first];
+          if (!st.active && now - kv.second > rule.timeout_us)
+            raise(rule, st, key_to_mac(kv.first), true,
+                  "nothing heard for " +
+                      to_string((now - kv.second) / 1000000) + " s",
+                  now);
+        }
+      } else if (rule.kind == Kind::Rate) {
+        for (auto &kv : states[i]) {
+          KeyState &st = kv.second;
+          if (!st.active)
+            continue;
+          auto a = rates.find(kv.first);
+          double rate = 0;
+          if (a != rates.end()) {
+            auto s = a->second.find(st.owner);
+            if (s != a->second.end())
+              rate = s->second.rate(now);
+          }
+          if (rate < rule.clear)
+            raise(rule, st, key_to_mac(kv.first), false,
+                  "rate back to " + to_string((int)rate) + " frames/s", now);
+        }
+      }
+    }
+
+    // keep the rate table and per attacker states bounded by live attacks
+    // (random MAC floods would grow them forever)
+    if (now - last_prune > rate_idle_us) {
+      for (auto a = rates.begin(); a != rates.end();) {
+        for (auto s = a->second.begin(); s != a->second.end();) {
+          int64_t newest = 0;
+          for (int b = 0; b < 10; ++b)
+            newest = max(newest, s->second.bucket_id[b] * bucket_us);
+          if (now - newest > rate_idle_us)
+            s = a->second.erase(s);
+          else
+            ++s;
+        }
+        if (a->second.empty())
+          a = rates.erase(a);
+        else
+          ++a;
+      }
+      for (size_t i = 0; i < rules.size(); ++i) {
+        const Rule &rule = rules[i];
+        // an idle new_mac key is new again anyway; without forget_s every
+        // attacker has to be remembered
+        int64_t idle_us;
+        if (rule.kind == Kind::Rate || rule.kind == Kind::Zone)
+          idle_us = max(rate_idle_us, rule.debounce_us);
+        else if (rule.kind == Kind::NewMac && rule.forget_us > 0)
+          idle_us = max(rule.forget_us, rule.debounce_us);
+        else
+          continue;
+        auto sweep = [&](auto &keys) {
+          for (auto it = keys.begin(); it != keys.end();) {
+            if (!it->second.active && now - it->second.last_seen > idle_us)
+              it = keys.erase(it);
+            else
+              ++it;
+          }
+        };
+        // zone keys are attacker strings, in their own table
+        if (rule.kind == Kind::Zone)
+          sweep(zone_states[i]);
+        else
+          sweep(states[i]);
+      }
+      last_prune = now;
+    }
+  }
+}
+
+void AlertEngine::dispatch_loop() {
+  while (true) {
+    Alert alert;
+    // CRITICAL SECTION
+    {
+      unique_lock<mutex> lock(outbox_mutex);
+      outbox_cv.wait(lock, [this] { return !running || !outbox.empty(); });
+      if (outbox.empty())
+        return; // stopped and drained
+      alert = std::move(outbox.front());
+      outbox.pop_front();
+    }
+
+    cout << "[ALERT] " << alert.rule << " " << alert.state << " " << alert.key
+         << ": " << alert.message << endl;
+    for (auto &sink : sinks)
+      sink->send(alert);
+  }
+}
@@ -0,0 +1,97 @@
+#include "../include/alert_sinks.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+using namespace std;
+
+string alert_to_json(const Alert &alert) {
+  // rule names and keys come from the rules file / MACs, only quotes need
+  // escaping
+  auto esc = [](const string &s) {
+    string out;
+    for (char c : s) {
+      if (c == '"' || c == '\\')
+        out += '\\';
+      out += c;
+    }
+    return out;
+  };
+  return "{\"ts\":" + to_string(alert.ts) + ",\"rule\":\"" + esc(alert.rule) +
+         "\",\"kind\":\"" + esc(alert.kind) + "\",\"key\":\"" +
+         esc(alert.key) + "\",\"state\":\"" + esc(alert.state) +
+         "\",\"message\":\"" + esc(alert.message) + "\"}";
+}
+
+FileAlertSink::FileAlertSink(const string &path) {
+  file = fopen(path.c_str(), "a");
+  if (!file)
+    cerr << "[alerts] Can't open " << path << ": " << strerror(errno) << endl;
+}
+
+FileAlertSink::~FileAlertSink() {
+  if (file)
+    fclose(file);
+}
+
+void FileAlertSink::send(const Alert &alert) {
+  if (!file)
+    return;
+  fprintf(file, "%s\n", alert_to_json(alert).c_str());
+  fflush(file);
+}
+
+SyslogAlertSink::SyslogAlertSink() {
+  openlog("deauthdetect", LOG_PID, LOG_DAEMON);
+}
+
+SyslogAlertSink::~SyslogAlertSink() { closelog(); }
+
+void SyslogAlertSink::send(const Alert &alert) {
+  syslog(alert.state == "firing" ? LOG_WARNING : LOG_NOTICE,
+         "[%s] %s %s: %s", alert.rule.c_str(), alert.state.c_str(),
+         alert.key.c_str(), alert.message.c_str());
+}
+
+WebhookAlertSink::WebhookAlertSink(const string &host, int port,
+                                   const string &path)
+    : host(host), port(port), path(path) {}
+
+void WebhookAlertSink::send(const Alert &alert) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return;
+  timeval tv{1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+      connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    cerr << "[alerts] Webhook " << host << ":" << port
+         << " unreachable: " << strerror(errno) << endl;
+    close(fd);
+    return;
+  }
+
+  string body = alert_to_json(alert);
+  string req = "POST " + path + " HTTP/1.0\r\nHost: " + host +
+               "\r\nContent-Type: application/json\r\nContent-Length: " +
+               to_string(body.size()) + "\r\n\r\n" + body;
+  size_t sent = 0;
+  while (sent < req.size()) {
+    ssize_t n = ::send(fd, req.data() + sent, req.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0)
+      break;
+    sent += n;
+  }
+  char buf[256]; // drain the status line, we don't care what it says
+  recv(fd, buf, sizeof(buf), 0);
+  close(fd);
+}
@@ -0,0 +1,74 @@
+#include "../include/alloc_counter.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+#ifdef DEAUTH_ALLOC_TRACKING
+
+static atomic<uint64_t> total_allocs{0};
+static atomic<uint64_t> total_bytes{0};
+static thread_local uint64_t thread_allocs = 0;
+
+static void *counted_alloc(size_t n, size_t align) {
+  total_allocs.fetch_add(1, memory_order_relaxed);
+  total_bytes.fetch_add(n, memory_order_relaxed);
+  thread_allocs++;
+  if (n == 0)
+    n = 1;
+  void *p = align <= alignof(max_align_t)
+                ? malloc(n)
+                : aligned_alloc(align, (n + align - 1) / align * align);
+  if (!p)
+    throw bad_alloc();
+  return p;
+}
+
+void *operator new(size_t n) { return counted_alloc(n, 0); }
+void *operator new[](size_t n) { return counted_alloc(n, 0); }
+void *operator new(size_t n, align_val_t a) {
+  return counted_alloc(n, (size_t)a);
+}
+void *operator new[](size_t n, align_val_t a) {
+  return counted_alloc(n, (size_t)a);
+}
+void *operator new(size_t n, const nothrow_t &) noexcept {
+  try {
+    return counted_alloc(n, 0);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void *operator new[](size_t n, const nothrow_t &) noexcept {
+  try {
+    return counted_alloc(n, 0);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, align_val_t) noexcept { free(p); }
+void operator delete[](void *p, align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, align_val_t) noexcept { free(p); }
+void operator delete(void *p, const nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const nothrow_t &) noexcept { free(p); }
+
+bool alloc_tracking_enabled() { return true; }
+uint64_t alloc_count() { return total_allocs.load(memory_order_relaxed); }
+uint64_t alloc_bytes() { return total_bytes.load(memory_order_relaxed); }
+uint64_t thread_alloc_count() { return thread_allocs; }
+
+#else
+
+bool alloc_tracking_enabled() { return false; }
+uint64_t alloc_count() { return 0; }
+uint64_t alloc_bytes() { return 0; }
+uint64_t thread_alloc_count() { return 0; }
+
+#endif // DEAUTH_ALLOC_TRACKING
@@ -0,0 +1,557 @@
+#include "../include/api_server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace std;
+
+static const size_t max_cache_entries = 256;
+static const int64_t max_event_rows = 5000;
+// longer windows are all of history anyway, and wm - s * 1e6 can't overflow
+static const int64_t max_window_s = 100LL * 365 * 86400;
+
+// Helper function
+static string json_escape(const string &s) {
+  string out;
+  out.reserve(s.size() + 2);
+  for (char c : s) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if ((unsigned char)c < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+  }
+  return out;
+}
+
+// Helper function
+static bool parse_int(const map<string, string> &params, const string &key,
+                      int64_t &out) {
+  auto it = params.find(key);
+  if (it == params.end())
+    return true; // keep default
+  char *end = nullptr;
+  errno = 0;
+  long long v = strtoll(it->second.c_str(), &end, 10);
+  if (errno != 0 || end == it->second.c_str() || *end != '\0')
+    return false;
+  out = v;
+  return true;
+}
+
+// Only accept AA:BB:CC:DD:EE:FF so values can go straight into SQL
+static bool is_mac(const string &s) {
+  if (s.size() != 17)
+    return false;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (i % 3 == 2) {
+      if (s[i] != ':')
+        return false;
+    } else if (!isxdigit((unsigned char)s[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Optional ?attacker=, empty when absent, false if it isn't a MAC
+static bool parse_attacker(const map<string, string> &params, string &out) {
+  out.clear();
+  auto it = params.find("attacker");
+  if (it == params.end())
+    return true;
+  string mac = it->second;
+  // %3A is what most clients send for ':'
+  for (size_t p; (p = mac.find("%3A")) != string::npos;)
+    mac.replace(p, 3, ":");
+  if (!is_mac(mac))
+    return false;
+  for (auto &c : mac)
+    c = toupper((unsigned char)c);
+  out = mac;
+  return true;
+}
+
+static string error_body(const string &msg) {
+  return "{\"error\":\"" + json_escape(msg) + "\"}";
+}
+
+static void send_all(int fd, const string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0)
+      return;
+    sent += n;
+  }
+}
+
+static void send_response(int fd, int status, const string &body) {
+  const char *reason = "OK";
+  switch (status) {
+  case 400:
+    reason = "Bad Request";
+    break;
+  case 404:
+    reason = "Not Found";
+    break;
+  case 405:
+    reason = "Method Not Allowed";
+    break;
+  case 500:
+    reason = "Internal Server Error";
+    break;
+  case 503:
+    reason = "Service Unavailable";
+    break;
+  case 504:
+    reason = "Gateway Timeout";
+    break;
+  }
+  string out = "HTTP/1.0 " + to_string(status) + " " + reason +
+               "\r\nContent-Type: application/json"
+               "\r\nContent-Length: " +
+               to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+  send_all(fd, out);
+}
+
+ApiServer::ApiServer(QueryScheduler &scheduler,
+                     const atomic<int64_t> &watermark, AttackerTracker &tracker,
+                     int port, int workers, int backlog, int timeout_ms)
+    : scheduler(scheduler), watermark(watermark), tracker(tracker),
+      port(port), num_workers(workers), backlog(backlog),
+      timeout_ms(timeout_ms) {}
+
+ApiServer::~ApiServer() { stop(); }
+
+bool ApiServer::start() {
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    cerr << "[api] socket: " << strerror(errno) << endl;
+    return false;
+  }
+  int one = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listen_fd, 128) < 0) {
+    cerr << "[api] bind/listen on port " << port << ": " << strerror(errno)
+         << endl;
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+
+  running = true;
+  for (int i = 0; i < num_workers; ++i)
+    workers.emplace_back(&ApiServer::worker_loop, this);
+  acceptor = thread(&ApiServer::accept_loop, this);
+
+  cerr << "[api] Listening on 127.0.0.1:" << port << " with " << num_workers
+       << " workers" << endl;
+  return true;
+}
+
+void ApiServer::stop() {
+  if (!running.exchange(false))
+    return;
+  pending_cv.notify_all();
+  if (acceptor.joinable())
+    acceptor.join();
+  for (auto &w : workers)
+    w.join();
+  workers.clear();
+
+  for (int fd : pending)
+    close(fd);
+  pending.clear();
+  if (listen_fd >= 0)
+    close(listen_fd);
+  listen_fd = -1;
+}
+
+void ApiServer::accept_loop() {
+  while (running) {
+    pollfd pfd{listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 200) <= 0)
+      continue; // timeout, re-check running
+
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+
+    timeval tv{2, 0}; // slow clients must not pin a worker
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // CRITICAL SECTION
+    {
+      lock_guard<mutex> lock(pending_mutex);
+      if (pending.size() < backlog) {
+        pending.push_back(fd);
+        fd = -1;
+      }
+    }
+
+    if (fd >= 0) { // workers saturated, shed the request
+      rejected++;
+      send_response(fd, 503, error_body("busy"));
+      close(fd);
+      continue;
+    }
+    pending_cv.notify_one();
+  }
+}
+
+void ApiServer::worker_loop() {
+  while (true) {
+    int fd;
+    // CRITICAL SECTION
+    {
+      unique_lock<mutex> lock(pending_mutex);
+      pending_cv.wait(lock, [this] { return !running || !pending.empty(); });
+      if (!running)
+        return;
+      fd = pending.front();
+      pending.pop_front();
+    }
+
+    handle_client(fd);
+    close(fd);
+  }
+}
+
+void ApiServer::handle_client(int fd) {
+  string req;
+  char buf[1024];
+  while (req.find("\r\n\r\n") == string::npos && req.size() < 8192) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+      break;
+    req.append(buf, n);
+  }
+  requests++;
+
+  // Request line: METHOD TARGET VERSION
+  istringstream line(req.substr(0, req.find("\r\n")));
+  string method, target;
+  line >> method >> target;
+  if (method.empty() || target.empty()) {
+    send_response(fd, 400, error_body("malformed request"));
+    return;
+  }
+  if (method != "GET") {
+    send_response(fd, 405, error_body("only GET is supported"));
+    return;
+  }
+
+  string path = target;
+  map<string, string> params;
+  size_t q = target.find('?');
+  if (q != string::npos) {
+    path = target.substr(0, q);
+    istringstream qs(target.substr(q + 1));
+    string kv;
+    while (getline(qs, kv, '&')) {
+      size_t eq = kv.find('=');
+      if (eq != string::npos)
+        params[kv.substr(0, eq)] = kv.substr(eq + 1);
+    }
+  }
+
+  // Everything but the live endpoints is a pure function of
+  // (target, watermark), so it can be served from the cache
+  bool cacheable =
+      path != "/positions" && path != "/stats" && path != "/health" &&
+      path != "/incidents";
+  int64_t wm = watermark.load();
+  string body;
+  if (cacheable && cache_get(target, wm, body)) {
+    cache_hits++;
+    send_response(fd, 200, body);
+    return;
+  }
+  if (cacheable)
+    cache_misses++;
+
+  int status = route(path, params, wm, body);
+  if (cacheable && status == 200)
+    cache_put(target, wm, body);
+  send_response(fd, status, body);
+}
+
+int ApiServer::route(const string &path, const map<string, string> &params,
+                     int64_t wm, string &body) {
+  if (path == "/positions") {
+    ostringstream out;
+    out << "{\"watermark\":" << wm << ",\"rows\":[";
+    bool first = true;
+    for (const auto &fix : tracker.snapshot()) {
+      out << (first ? "" : ",") << "{\"attack_mac\":\""
+          << json_escape(fix.attack_mac) << "\",\"x\":" << fix.x
+          << ",\"y\":" << fix.y << ",\"sensors\":" << fix.sensors
+          << ",\"ts_min\":" << fix.ts_min << ",\"ts_max\":" << fix.ts_max
+          << ",\"fixed_at\":" << fix.fixed_at << "}";
+      first = false;
+    }
+    out << "]}";
+    body = out.str();
+    return 200;
+  }
+
+  if (path == "/stats") {
+    body = "{\"watermark\":" + to_string(wm) +
+           ",\"requests\":" + to_string(requests.load()) +
+           ",\"cache_hits\":" + to_string(cache_hits.load()) +
+           ",\"cache_misses\":" + to_string(cache_misses.load()) +
+           ",\"rejected\":" + to_string(rejected.load()) +
+           ",\"query_timeouts\":" + to_string(scheduler.timeouts()) +
+           ",\"query_rejections\":" + to_string(scheduler.rejections());
+    if (ingest_stats) {
+      const IngestStats &st = *ingest_stats;
+      body += ",\"ingest\":{\"received\":" + to_string(st.received) +
+              ",\"enqueued\":" + to_string(st.enqueued) +
+              ",\"appended\":" + to_string(st.appended) +
+              ",\"dropped_oldest\":" + to_string(st.dropped_oldest) +
+              ",\"sampled_out\":" + to_string(st.sampled_out) +
+              ",\"edges_kept\":" + to_string(st.edges_kept) +
+              ",\"blocked\":" + to_string(st.blocked) +
+              ",\"early_flushes\":" + to_string(st.early_flushes) +
+              ",\"max_depth\":" + to_string(st.max_depth) + "}";
+    }
+    body += "}";
+    return 200;
+  }
+
+  if (path == "/health") {
+    if (!health) {
+      body = error_body("sensor health not available");
+      return 404;
+    }
+    int64_t now = now_us();
+    ostringstream out;
+    out << "{\"now\":" << now << ",\"sensors\":[";
+    vector<SensorStatus> report;
+    health->report(now, report);
+    bool first = true;
+    for (const auto &st : report) {
+      out << (first ? "" : ",") << "{\"sensor_mac\":\""
+          << json_escape(st.sensor_mac) << "\",\"state\":\""
+          << sensor_state_name(st.state) << "\",\"last_seen\":"
+          << st.last_seen << ",\"last_event\":" << st.last_event
+          << ",\"last_heartbeat\":" << st.last_heartbeat
+          << ",\"events\":" << st.events
+          << ",\"heartbeats\":" << st.heartbeats << "}";
+      first = false;
+    }
+    out << "]}";
+    body = out.str();
+    return 200;
+  }
+
+  if (path == "/incidents") {
+    if (!incidents) {
+      body = error_body("incidents not available");
+      return 404;
+    }
+    // open incidents run past the watermark, so default to now
+    int64_t now = now_us();
+    int64_t from = now - 3600 * 1000000LL, to = now, limit = 100;
+    string mac;
+    if (!parse_int(params, "from", from) || !parse_int(params, "to", to) ||
+        !parse_int(params, "limit", limit) || from > to || limit <= 0) {
+      body = error_body("bad from/to/limit");
+      return 400;
+    }
+    if (!parse_attacker(params, mac)) {
+      body = error_body("bad attacker mac");
+      return 400;
+    }
+    if (limit > max_event_rows)
+      limit = max_event_rows;
+
+    ostringstream out;
+    out << "{\"now\":" << now << ",\"rows\":[";
+    bool first = true;
+    for (const auto &inc : incidents->query(from, to, mac, limit)) {
+      out << (first ? "" : ",") << "{\"id\":" << inc.id
+          << ",\"attack_mac\":\"" << inc.attack_mac
+          << "\",\"start\":" << inc.start << ",\"end\":" << inc.end
+          << ",\"open\":" << (inc.open ? "true" : "false")
+          << ",\"events\":" << inc.events << ",\"frames\":" << inc.frames
+          << ",\"peak_rate\":" << inc.peak_rate
+          << ",\"confidence\":" << inc.confidence << ",\"sensors\":[";
+      for (size_t s = 0; s < inc.sensors.size(); ++s)
+        out << (s ? ",\"" : "\"") << inc.sensors[s].mac << "\"";
+      out << "],\"track\":[";
+      for (size_t p = 0; p < inc.track.size(); ++p)
+        out << (p ? ",[" : "[") << inc.track[p].ts << "," << inc.track[p].x
+            << "," << inc.track[p].y << "]";
+      out << "]}";
+      first = false;
+    }
+    out << "]}";
+    body = out.str();
+    return 200;
+  }
+
+  string sql;
+  if (path == "/attackers") {
+    int64_t active_s = 10;
+    if (!parse_int(params, "active_s", active_s) || active_s <= 0) {
+      body = error_body("bad active_s");
+      return 400;
+    }
+    active_s = min(active_s, max_window_s);
+    sql = "SELECT attack_mac, MIN(timestamp) AS first_seen, "
+          "MAX(timestamp) AS last_seen, COUNT(*) AS events, "
+          "SUM(frame_count) AS total_frames, "
+          "COUNT(DISTINCT sensor_mac) AS sensors "
+          "FROM events WHERE timestamp >= " +
+          to_string(wm - active_s * 1000000) +
+          " AND timestamp <= " + to_string(wm) +
+          " GROUP BY attack_mac ORDER BY last_seen DESC;";
+  } else if (path == "/sensors") {
+    int64_t window_s = 60;
+    if (!parse_int(params, "window_s", window_s) || window_s <= 0) {
+      body = error_body("bad window_s");
+      return 400;
+    }
+    window_s = min(window_s, max_window_s);
+    sql = "SELECT sensor_mac, COUNT(*) AS events, AVG(rssi_mean) AS avg_rssi, "
+          "AVG(rssi_variance) AS avg_variance, "
+          "SUM(frame_count) AS total_frames, MAX(timestamp) AS last_seen "
+          "FROM events WHERE timestamp >= " +
+          to_string(wm - window_s * 1000000) +
+          " AND timestamp <= " + to_string(wm) +
+          " GROUP BY sensor_mac ORDER BY sensor_mac;";
+  } else if (path == "/events") {
+    int64_t from = wm - 60 * 1000000LL, to = wm, limit = 1000;
+    if (!parse_int(params, "from", from) || !parse_int(params, "to", to) ||
+        !parse_int(params, "limit", limit) || from > to || limit <= 0) {
+      body = error_body("bad from/to/limit");
+      return 400;
+    }
+    if (limit > max_event_rows)
+      limit = max_event_rows;
+
+    string mac, attacker_filter;
+    if (!parse_attacker(params, mac)) {
+      body = error_body("bad attacker mac");
+      return 400;
+    }
+    if (!mac.empty())
+      attacker_filter = " AND attack_mac = '" + mac + "'";
+
+    sql = "SELECT timestamp, attack_mac, sensor_mac, rssi_mean, "
+          "rssi_variance, frame_count FROM events WHERE timestamp >= " +
+          to_string(from) + " AND timestamp <= " + to_string(to) +
+          attacker_filter + " ORDER BY timestamp LIMIT " + to_string(limit) +
+          ";";
+  } else {
+    body = error_body("unknown endpoint");
+    return 404;
+  }
+
+  int status = 200;
+  string rows = run_query(sql, status);
+  if (status != 200) {
+    body = rows;
+    return status;
+  }
+  body = "{\"watermark\":" + to_string(wm) + ",\"rows\":" + rows + "}";
+  return 200;
+}
+
+// Run a query and render the result as a JSON array of row objects
+string ApiServer::run_query(const string &sql, int &status) {
+  auto scheduled = scheduler.query(sql, QueryPriority::Interactive, timeout_ms);
+  if (!scheduled.ok()) {
+    cerr << "[api] Query failed: " << scheduled.error << endl;
+    if (scheduled.timed_out)
+      status = 504;
+    else if (scheduled.error == "query queue full")
+      status = 503;
+    else
+      status = 500;
+    return error_body(scheduled.error);
+  }
+  auto &result = scheduled.result;
+
+  ostringstream out;
+  out << "[";
+  for (size_t row = 0; row < result->RowCount(); ++row) {
+    out << (row ? ",{" : "{");
+    for (size_t col = 0; col < result->ColumnCount(); ++col) {
+      auto v = result->GetValue(col, row);
+      out << (col ? ",\"" : "\"") << json_escape(result->ColumnName(col))
+          << "\":";
+      if (v.IsNull())
+        out << "null";
+      else if (result->types[col].IsNumeric())
+        out << v.ToString();
+      else
+        out << "\"" << json_escape(v.ToString()) << "\"";
+    }
+    out << "}";
+  }
+  out << "]";
+  status = 200;
+  return out.str();
+}
+
+bool ApiServer::cache_get(const string &key, int64_t wm, string &body) {
+  lock_guard<mutex> lock(cache_mutex);
+  auto it = cache.find(key);
+  if (it == cache.end() || it->second.watermark != wm)
+    return false;
+  body = it->second.body;
+  return true;
+}
+
+void ApiServer::cache_put(const string &key, int64_t wm, const string &body) {
+  lock_guard<mutex> lock(cache_mutex);
+  if (cache.size() >= max_cache_entries && cache.find(key) == cache.end()) {
+    // drop everything the watermark has already invalidated first
+    for (auto it = cache.begin(); it != cache.end();) {
+      if (it->second.watermark != wm)
+        it = cache.erase(it);
+      else
+        ++it;
+    }
+    if (cache.size() >= max_cache_entries)
+      cache.clear();
+  }
+  cache[key] = {wm, body};
+}
@@ -0,0 +1,16 @@
+#include "../include/attacker_tracker.h"
+using namespace std;
+
+void AttackerTracker::update(const AttackerFix &fix) {
+  lock_guard<mutex> lock(mtx);
+  latest[fix.attack_mac] = fix;
+}
+
+vector<AttackerFix> AttackerTracker::snapshot() const {
+  lock_guard<mutex> lock(mtx);
+  vector<AttackerFix> out;
+  out.reserve(latest.size());
+  for (const auto &kv : latest)
+    out.push_back(kv.second);
+  return out;
+}
@@ -0,0 +1,40 @@
+#include "../include/deauth_event.h"
+#include <chrono>
+using namespace std;
+
+bool operator>(const wifi_deauth_event_t &a, const wifi_deauth_event_t &b) {
+  return a.timestamp > b.timestamp;
+}
+
+bool is_heartbeat(const wifi_deauth_event_t &event) {
+  if (event.frame_count != 0)
+    return false;
+  for (int i = 0; i < 6; ++i)
+    if (event.attack_mac[i] != 0)
+      return false;
+  return true;
+}
+
+// Helper function
+int64_t now_us() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Helper function
+void bytes_to_mac(const uint8_t mac[6], char out[18]) {
+  static const char hex[] = "0123456789ABCDEF";
+  for (int i = 0; i < 6; ++i) {
+    out[i * 3] = hex[mac[i] >> 4];
+    out[i * 3 + 1] = hex[mac[i] & 0xF];
+    out[i * 3 + 2] = ':';
+  }
+  out[17] = '\0';
+}
+
+string bytes_to_mac(const uint8_t mac[6]) {
+  char buf[18];
+  bytes_to_mac(mac, buf);
+  return std::string(buf);
+}
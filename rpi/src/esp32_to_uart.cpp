@@ -27,15 +27,16 @@ bool configureSerialPort(int fd, int speed) {
   cfsetispeed(&tty, speed);
 
   tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8; // 8-bit characters
-  tty.c_iflag &= ~IGNBRK;                     // disable break processing
+  // raw input: events are binary, a 0x0D byte must not turn into 0x0A
+  // (ICRNL) or vanish (IGNCR), 0x11/0x13 must not pause the port (IXON)
+  tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL |
+                   IXON | IXOFF | IXANY);
   tty.c_lflag = 0;                            // no signaling chars, no echo, no
                                               // canonical processing
   tty.c_oflag = 0;                            // no remapping, no delays
   tty.c_cc[VMIN] = 0;                         // read doesn't block
   tty.c_cc[VTIME] = 5;                        // 0.5 seconds read timeout
 
-  tty.c_iflag &= ~(IXON | IXOFF | IXANY); // shut off xon/xoff ctrl
-
   tty.c_cflag |= (CLOCAL | CREAD);   // ignore modem controls,
                                      // enable reading
   tty.c_cflag &= ~(PARENB | PARODD); // shut off parity
@@ -0,0 +1,432 @@
+#include "../include/event_journal.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+using namespace std;
+
+// 02: records carry a sequence number, 01 keyed them by timestamp
+static const char segment_magic[8] = {'D', 'D', 'J', 'R', 'N', 'L', '0', '2'};
+static const size_t header_bytes = 64;
+
+// One slot per event, fixed size so offsets never need parsing
+struct __attribute__((packed)) JournalRecord {
+  uint32_t crc; // over everything after this field
+  uint32_t len; // sizeof(wifi_deauth_event_t), 0 = end of segment
+  wifi_deauth_event_t event;
+  uint64_t seq;
+  uint8_t pad[48 - 16 - sizeof(wifi_deauth_event_t)];
+};
+static_assert(sizeof(JournalRecord) == 48, "journal record must be 48 bytes");
+
+// CRC-32 (IEEE, same as zlib). Cortex-A72 has the ARMv8 CRC32 instructions
+// for this exact polynomial, otherwise fall back to a table.
+static uint32_t crc32(const uint8_t *p, size_t n) {
+  uint32_t crc = 0xFFFFFFFF;
+#if defined(__ARM_FEATURE_CRC32)
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc = __crc32d(crc, v);
+  }
+  for (; n > 0; ++p, --n)
+    crc = __crc32b(crc, *p);
+#else
+  static uint32_t table[256];
+  static bool init = [] {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    return true;
+  }();
+  (void)init;
+  for (; n > 0; ++p, --n)
+    crc = table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+#endif
+  return crc ^ 0xFFFFFFFF;
+}
+
+static uint32_t record_crc(const JournalRecord &rec) {
+  return crc32((const uint8_t *)&rec + 4, sizeof(rec) - 4);
+}
+
+EventJournal::EventJournal(const string &dir, size_t segment_bytes,
+                           int fsync_ms, size_t keep_bytes)
+    : dir(dir), fsync_ms(fsync_ms), keep_bytes(keep_bytes) {
+  // at least a handful of records, and whole records only
+  segment_bytes = max<size_t>(segment_bytes, header_bytes + 64 * 48);
+  this->segment_bytes =
+      header_bytes + (segment_bytes - header_bytes) / 48 * 48;
+}
+
+EventJournal::~EventJournal() { stop(); }
+
+string EventJournal::segment_path(uint32_t index) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/seg-%08u.jnl", index);
+  return dir + name;
+}
+
+bool EventJournal::replay(vector<SequencedEvent> &pending) {
+  if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+    cerr << "[journal] mkdir " << dir << ": " << strerror(errno) << endl;
+    return false;
+  }
+
+  // commit mark: 8 byte sequence + crc of it
+  int mfd = open((dir + "/commit-seq").c_str(), O_RDONLY);
+  if (mfd >= 0) {
+    uint8_t buf[12];
+    if (read(mfd, buf, sizeof(buf)) == (ssize_t)sizeof(buf)) {
+      uint32_t crc;
+      memcpy(&crc, buf + 8, 4);
+      if (crc == crc32(buf, 8)) {
+        uint64_t mark;
+        memcpy(&mark, buf, 8);
+        commit_mark = persisted_mark = mark;
+      } else {
+        cerr << "[journal] Commit mark corrupt, replaying everything" << endl;
+      }
+    }
+    close(mfd);
+  }
+
+  vector<uint32_t> indexes;
+  DIR *d = opendir(dir.c_str());
+  if (!d) {
+    cerr << "[journal] opendir " << dir << ": " << strerror(errno) << endl;
+    return false;
+  }
+  while (dirent *ent = readdir(d)) {
+    unsigned int idx;
+    if (sscanf(ent->d_name, "seg-%8u.jnl", &idx) == 1)
+      indexes.push_back(idx);
+  }
+  closedir(d);
+  sort(indexes.begin(), indexes.end());
+
+  vector<SequencedEvent> found;
+  uint64_t newest = commit_mark;
+  size_t torn = 0;
+  for (uint32_t idx : indexes) {
+    next_index = max(next_index, idx + 1);
+    string path = segment_path(idx);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      continue;
+    struct stat st;
+    fstat(fd, &st);
+    vector<uint8_t> data(st.st_size);
+    ssize_t got = read(fd, data.data(), data.size());
+    close(fd);
+
+    if (got >= (ssize_t)header_bytes &&
+        memcmp(data.data(), segment_magic, 7) == 0 &&
+        data[7] != (uint8_t)segment_magic[7]) {
+      cerr << "[journal] " << path << " is from another format version, "
+           << "left alone" << endl;
+      continue;
+    }
+    if (got < (ssize_t)header_bytes ||
+        memcmp(data.data(), segment_magic, sizeof(segment_magic)) != 0) {
+      // never got its header (crash while creating), nothing to replay
+      unlink(path.c_str());
+      continue;
+    }
+
+    for (size_t off = header_bytes; off + sizeof(JournalRecord) <= (size_t)got;
+         off += sizeof(JournalRecord)) {
+      JournalRecord rec;
+      memcpy(&rec, data.data() + off, sizeof(rec));
+      if (rec.len == 0)
+        break; // unused tail
+      if (rec.len != sizeof(wifi_deauth_event_t) || rec.crc != record_crc(rec)) {
+        torn++; // torn write at the crash point, the rest is garbage
+        break;
+      }
+      uint64_t seq = rec.seq;
+      newest = max(newest, seq);
+      if (keep_bytes > 0 || seq > commit_mark)
+        found.push_back({rec.event, seq});
+    }
+    old_segments.emplace_back(path, (size_t)got);
+  }
+
+  // arrival order, which is what the queue would have seen
+  sort(found.begin(), found.end(),
+       [](const SequencedEvent &a, const SequencedEvent &b) {
+         return a.seq < b.seq;
+       });
+  pending.insert(pending.end(), found.begin(), found.end());
+  next_seq = newest + 1;
+  cerr << "[journal] " << indexes.size() << " segments, commit mark "
+       << commit_mark << ", " << pending.size() << " events to replay";
+  if (torn)
+    cerr << ", " << torn << " torn tail(s) skipped";
+  cerr << endl;
+  return true;
+}
+
+void EventJournal::skip_to(uint64_t seq) {
+  next_seq = max(next_seq, seq + 1);
+}
+
+unique_ptr<EventJournal::Segment> EventJournal::create_segment(uint32_t index) {
+  unique_ptr<Segment> seg(new Segment());
+  seg->index = index;
+  seg->path = segment_path(index);
+  seg->size = segment_bytes;
+  seg->fd = open(seg->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (seg->fd < 0) {
+    cerr << "[journal] open " << seg->path << ": " << strerror(errno) << endl;
+    return nullptr;
+  }
+  // allocate the blocks now so appends never wait on the filesystem
+  if (posix_fallocate(seg->fd, 0, seg->size) != 0 &&
+      ftruncate(seg->fd, seg->size) != 0) {
+    cerr << "[journal] allocate " << seg->path << ": " << strerror(errno)
+         << endl;
+    close(seg->fd);
+    return nullptr;
+  }
+  void *p = mmap(nullptr, seg->size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, seg->fd, 0);
+  if (p == MAP_FAILED) {
+    cerr << "[journal] mmap " << seg->path << ": " << strerror(errno) << endl;
+    close(seg->fd);
+    return nullptr;
+  }
+  seg->base = (uint8_t *)p;
+  memcpy(seg->base, segment_magic, sizeof(segment_magic));
+  memcpy(seg->base + sizeof(segment_magic), &index, sizeof(index));
+  seg->write_off = header_bytes;
+  // the file itself has to survive a power cut, not just its pages
+  sync_dir();
+  return seg;
+}
+
+void EventJournal::close_segment(Segment &seg) {
+  if (seg.base)
+    munmap(seg.base, seg.size);
+  if (seg.fd >= 0)
+    close(seg.fd);
+  seg.base = nullptr;
+  seg.fd = -1;
+}
+
+bool EventJournal::start() {
+  active = create_segment(next_index++);
+  if (!active)
+    return false;
+
+  // Everything in the old segments was replayed and committed by now
+  for (const auto &old : old_segments)
+    retire(old.first, old.second);
+  old_segments.clear();
+
+  running = true;
+  flusher = thread(&EventJournal::flusher_loop, this);
+  cerr << "[journal] Writing to " << dir << " (" << segment_bytes / 1024
+       << " KiB segments, fsync every " << fsync_ms << " ms)" << endl;
+  return true;
+}
+
+void EventJournal::stop() {
+  if (!running.exchange(false))
+    return;
+  flusher.join();
+
+  for (auto &seg : sealed)
+    sync_segment(*seg);
+  sync_segment(*active);
+  persist_mark(commit_mark);
+
+  for (auto &seg : sealed) {
+    close_segment(*seg);
+    if (seg->last_seq <= persisted_mark)
+      retire(seg->path, seg->size);
+  }
+  sealed.clear();
+  close_segment(*active);
+  if (spare) {
+    close_segment(*spare);
+    unlink(spare->path.c_str());
+  }
+}
+
+void EventJournal::roll_over() {
+  unique_ptr<Segment> next;
+  uint32_t index = 0;
+  // CRITICAL SECTION
+  {
+    lock_guard<mutex> lock(seg_mutex);
+    next = std::move(spare);
+    if (!next)
+      index = next_index++;
+  }
+  if (!next) // flusher fell behind, pay for it here
+    next = create_segment(index);
+  if (!next)
+    return; // append() drops until a segment can be created
+
+  lock_guard<mutex> lock(seg_mutex);
+  sealed.push_back(std::move(active));
+  active = std::move(next);
+}
+
+uint64_t EventJournal::append(const wifi_deauth_event_t &event) {
+  // dropped records still use up their number, so the order holds
+  uint64_t seq = next_seq++;
+  if (!active)
+    return seq;
+  size_t off = active->write_off.load(memory_order_relaxed);
+  if (off + sizeof(JournalRecord) > active->size) {
+    roll_over();
+    off = active->write_off.load(memory_order_relaxed);
+    if (off + sizeof(JournalRecord) > active->size)
+      return seq;
+  }
+
+  JournalRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.len = sizeof(wifi_deauth_event_t);
+  rec.event = event;
+  rec.seq = seq;
+  rec.crc = record_crc(rec);
+  memcpy(active->base + off, &rec, sizeof(rec));
+
+  active->last_seq = seq;
+  active->write_off.store(off + sizeof(JournalRecord), memory_order_release);
+  appended_count++;
+  return seq;
+}
+
+void EventJournal::commit(uint64_t seq) {
+  if (seq > commit_mark)
+    commit_mark = seq;
+}
+
+void EventJournal::sync_segment(Segment &seg) {
+  size_t end = seg.write_off.load(memory_order_acquire);
+  if (end <= seg.synced_off)
+    return;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = seg.synced_off / page * page;
+  if (msync(seg.base + start, end - start, MS_SYNC) == 0) {
+    seg.synced_off = end;
+    sync_count++;
+  }
+}
+
+bool EventJournal::sync_dir() {
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    return false;
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+// mark file is replaced atomically so a crash leaves the old or new value,
+// and the rename only counts once the directory is synced too
+void EventJournal::persist_mark(uint64_t mark) {
+  if (mark == persisted_mark)
+    return;
+  uint8_t buf[12];
+  memcpy(buf, &mark, 8);
+  uint32_t crc = crc32(buf, 8);
+  memcpy(buf + 8, &crc, 4);
+
+  string tmp = dir + "/commit-seq.tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return;
+  bool ok = write(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf) &&
+            fdatasync(fd) == 0;
+  close(fd);
+  if (ok && rename(tmp.c_str(), (dir + "/commit-seq").c_str()) == 0 &&
+      sync_dir())
+    persisted_mark = mark;
+}
+
+// A committed segment is deleted, or kept for an in-memory DB until the
+// newer ones fill keep_bytes. Flusher thread, or start()/stop() around it.
+void EventJournal::retire(const string &path, size_t size) {
+  if (keep_bytes == 0) {
+    unlink(path.c_str());
+    return;
+  }
+  kept.emplace_back(path, size);
+  kept_bytes += size;
+  while (kept_bytes > keep_bytes && kept.size() > 1) {
+    unlink(kept.front().first.c_str());
+    kept_bytes -= kept.front().second;
+    kept.pop_front();
+  }
+}
+
+void EventJournal::flusher_loop() {
+  while (running) {
+    this_thread::sleep_for(chrono::milliseconds(fsync_ms));
+
+    // sealed segments are only destroyed here, so the pointers stay valid
+    // after the lock is dropped even if the reader rolls over meanwhile
+    vector<Segment *> dirty;
+    // CRITICAL SECTION
+    {
+      lock_guard<mutex> lock(seg_mutex);
+      for (auto &seg : sealed)
+        dirty.push_back(seg.get());
+      dirty.push_back(active.get());
+    }
+    for (Segment *seg : dirty)
+      sync_segment(*seg);
+
+    persist_mark(commit_mark);
+
+    // unmap fully committed segments and keep a spare ready
+    bool need_spare;
+    vector<unique_ptr<Segment>> done;
+    // CRITICAL SECTION
+    {
+      lock_guard<mutex> lock(seg_mutex);
+      for (auto it = sealed.begin(); it != sealed.end();) {
+        if ((*it)->last_seq <= persisted_mark &&
+            (*it)->synced_off == (*it)->write_off) {
+          done.push_back(std::move(*it));
+          it = sealed.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      need_spare = !spare;
+    }
+    for (auto &seg : done) {
+      close_segment(*seg);
+      retire(seg->path, seg->size);
+    }
+    if (need_spare) {
+      uint32_t index;
+      // CRITICAL SECTION
+      {
+        lock_guard<mutex> lock(seg_mutex);
+        index = next_index++;
+      }
+      auto seg = create_segment(index);
+      lock_guard<mutex> lock(seg_mutex);
+      spare = std::move(seg);
+    }
+  }
+}
@@ -0,0 +1,703 @@
+#include "../include/federation.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+using namespace std;
+
+static const uint32_t frame_magic = 0x31464444; // "DDF1"
+static const size_t batch_events = 512;
+static const int64_t batch_us = 20000;         // seal a partial batch after
+static const int64_t dedup_us = 500000;        // same frame via two gateways
+static const int64_t edge_check_us = 100000;   // like read_events
+static const size_t max_nodes = 256;
+// partial frames held across all node connections, past it the biggest
+// buffer's node is dropped (it resends whatever wasn't acked)
+static const size_t max_buffered = 64 * 1024 * 1024;
+static const size_t keep_buffer = 1024 * 1024; // capacity kept when idle
+
+// ---- encoding ----
+
+static void put_varint(string &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back((char)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((char)v);
+}
+
+static uint64_t zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint64_t mac_key(const uint8_t mac[6]) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; ++i)
+    key = (key << 8) | mac[i];
+  return key;
+}
+
+// bounds checked cursor over a payload
+struct Cursor {
+  const uint8_t *p;
+  const uint8_t *end;
+  bool ok = true;
+
+  uint64_t varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p >= end)
+        break;
+      uint8_t b = *p++;
+      v |= (uint64_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+    ok = false;
+    return 0;
+  }
+
+  void bytes(void *dst, size_t n) {
+    if ((size_t)(end - p) < n) {
+      ok = false;
+      return;
+    }
+    memcpy(dst, p, n);
+    p += n;
+  }
+};
+
+void encode_batch(const wifi_deauth_event_t *events, size_t count,
+                  string &out) {
+  // dictionary index per MAC, in first-seen order
+  static thread_local unordered_map<uint64_t, uint32_t> index;
+  static thread_local vector<const uint8_t *> dict;
+  static thread_local vector<uint32_t> refs;
+  index.clear();
+  dict.clear();
+  refs.clear();
+  auto ref = [&](const uint8_t mac[6]) {
+    auto it = index.emplace(mac_key(mac), (uint32_t)dict.size());
+    if (it.second)
+      dict.push_back(mac);
+    refs.push_back(it.first->second);
+  };
+  for (size_t i = 0; i < count; ++i) {
+    ref(events[i].attack_mac);
+    ref(events[i].sensor_mac);
+  }
+
+  put_varint(out, count);
+  put_varint(out, dict.size());
+  for (const uint8_t *mac : dict)
+    out.append((const char *)mac, 6);
+
+  int64_t prev_ts = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const wifi_deauth_event_t &ev = events[i];
+    put_varint(out, refs[2 * i]);
+    put_varint(out, refs[2 * i + 1]);
+    out.push_back((char)ev.rssi_mean);
+    float variance = ev.rssi_variance; // packed member, copy first
+    out.append((const char *)&variance, sizeof(variance));
+    put_varint(out, zigzag(ev.frame_count));
+    put_varint(out, zigzag(ev.timestamp - prev_ts));
+    prev_ts = ev.timestamp;
+  }
+}
+
+bool decode_batch(const uint8_t *data, size_t len,
+                  vector<wifi_deauth_event_t> &out) {
+  Cursor in{data, data + len};
+  uint64_t count = in.varint();
+  uint64_t dict_size = in.varint();
+  // every event takes at least 8 bytes, every MAC 6
+  if (!in.ok || count > len / 8 || dict_size > len / 6)
+    return false;
+  const uint8_t *dict = in.p;
+  if ((size_t)(in.end - in.p) < dict_size * 6)
+    return false;
+  in.p += dict_size * 6;
+
+  out.clear();
+  out.reserve(count);
+  int64_t ts = 0;
+  for (uint64_t i = 0; i < count && in.ok; ++i) {
+    wifi_deauth_event_t ev;
+    uint64_t a = in.varint(), s = in.varint();
+    if (a >= dict_size || s >= dict_size)
+      return false;
+    memcpy(ev.attack_mac, dict + a * 6, 6);
+    memcpy(ev.sensor_mac, dict + s * 6, 6);
+    int8_t rssi = 0;
+    in.bytes(&rssi, 1);
+    ev.rssi_mean = rssi;
+    float variance = 0;
+    in.bytes(&variance, sizeof(variance));
+    ev.rssi_variance = variance;
+    ev.frame_count = (int)unzigzag(in.varint());
+    ts += unzigzag(in.varint());
+    ev.timestamp = ts;
+    out.push_back(ev);
+  }
+  return in.ok && in.p == in.end;
+}
+
+string make_frame(FrameType type, const string &payload) {
+  string frame(frame_header_size, '\0');
+  uint32_t len = (uint32_t)payload.size();
+  memcpy(&frame[0], &frame_magic, 4);
+  frame[4] = (char)type;
+  memcpy(&frame[8], &len, 4);
+  frame += payload;
+  return frame;
+}
+
+// Pulls complete frames off the front of buf. Returns false on garbage.
+template <class Fn> static bool parse_frames(string &buf, Fn &&handle) {
+  size_t off = 0;
+  bool ok = true;
+  while (ok && buf.size() - off >= frame_header_size) {
+    uint32_t magic, len;
+    memcpy(&magic, &buf[off], 4);
+    memcpy(&len, &buf[off + 8], 4);
+    if (magic != frame_magic || len > max_frame_payload) {
+      ok = false;
+      break;
+    }
+    if (buf.size() - off < frame_header_size + len)
+      break;
+    ok = handle((FrameType)buf[off + 4],
+                (const uint8_t *)&buf[off + frame_header_size], len);
+    off += frame_header_size + len;
+  }
+  buf.erase(0, off);
+  return ok;
+}
+
+static bool send_all(int fd, const string &data, int flags) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = ::send(fd, data.data() + sent, data.size() - sent,
+                       MSG_NOSIGNAL | flags);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    sent += n;
+  }
+  return true;
+}
+
+static string seq_payload(uint64_t seq) {
+  return string((const char *)&seq, sizeof(seq));
+}
+
+// ---- node side ----
+
+Uplink::Uplink(const string &host, int port, uint32_t node_id,
+               size_t backlog_events)
+    : host(host), port(port), node_id(node_id), session(now_us()),
+      max_backlog(max<size_t>(backlog_events, batch_events)) {
+  open.reserve(batch_events);
+}
+
+Uplink::~Uplink() { stop(); }
+
+bool Uplink::start() {
+  cerr << "[uplink] Node " << node_id << " streaming to " << host << ":"
+       << port << endl;
+  running = true;
+  sender = thread(&Uplink::run, this);
+  return true;
+}
+
+void Uplink::stop() {
+  if (!running.exchange(false))
+    return;
+  cv.notify_all();
+  if (sender.joinable())
+    sender.join();
+  disconnect();
+}
+
+size_t Uplink::backlog() const {
+  lock_guard<mutex> lock(mtx);
+  return pending_events + unencoded_events + open.size();
+}
+
+void Uplink::send(const wifi_deauth_event_t &event) {
+  // CRITICAL SECTION
+  lock_guard<mutex> lock(mtx);
+  if (open.empty())
+    open_since = now_us();
+  open.push_back(event);
+  if (open.size() >= batch_events)
+    seal_locked();
+}
+
+// Just a buffer swap, the sender encodes it later outside the lock
+void Uplink::seal_locked() {
+  if (open.empty())
+    return;
+  unencoded_events += open.size();
+  unencoded.push_back(std::move(open));
+  open.clear();
+  if (!spare.empty()) {
+    open = std::move(spare.back());
+    spare.pop_back();
+  } else {
+    open.reserve(batch_events);
+  }
+  trim_locked();
+}
+
+// aggregator gone for too long, make room, oldest (encoded) batches first
+void Uplink::trim_locked() {
+  while (pending_events + unencoded_events > max_backlog) {
+    if (!pending.empty()) {
+      pending_events -= pending.front().events;
+      dropped += pending.front().events;
+      pending.pop_front();
+      if (next_unsent > 0)
+        next_unsent--;
+    } else if (unencoded.size() > 1) {
+      unencoded_events -= unencoded.front().size();
+      dropped += unencoded.front().size();
+      unencoded.pop_front();
+    } else {
+      break;
+    }
+  }
+}
+
+bool Uplink::connect_upstream() {
+  addrinfo hints{}, *res = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &res) != 0)
+    return false;
+
+  int s = -1;
+  for (addrinfo *ai = res; ai && s < 0; ai = ai->ai_next) {
+    s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (s < 0)
+      continue;
+    // don't hang on an unreachable host, stop() waits for us
+    fcntl(s, F_SETFL, O_NONBLOCK);
+    int r = connect(s, ai->ai_addr, ai->ai_addrlen);
+    if (r < 0 && errno == EINPROGRESS) {
+      pollfd pfd{s, POLLOUT, 0};
+      int err = 0;
+      socklen_t errlen = sizeof(err);
+      if (poll(&pfd, 1, 2000) == 1 &&
+          getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 && err == 0)
+        r = 0;
+    }
+    if (r < 0) {
+      close(s);
+      s = -1;
+    }
+  }
+  freeaddrinfo(res);
+  if (s < 0)
+    return false;
+
+  fcntl(s, F_SETFL, 0);
+  int one = 1;
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  timeval tv{2, 0}; // a stuck aggregator looks like a disconnect
+  setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  string hello((const char *)&node_id, sizeof(node_id));
+  hello.append((const char *)&session, sizeof(session));
+  if (!send_all(s, make_frame(FrameType::Hello, hello), 0)) {
+    close(s);
+    return false;
+  }
+
+  size_t resend;
+  {
+    lock_guard<mutex> lock(mtx);
+    next_unsent = 0; // whatever wasn't acked goes again
+    resend = pending.size();
+  }
+  inbuf.clear();
+  fd = s;
+  cerr << "[uplink] Connected to " << host << ":" << port << ", " << resend
+       << " batches to resend" << endl;
+  return true;
+}
+
+void Uplink::disconnect() {
+  int s = fd.exchange(-1);
+  if (s < 0)
+    return;
+  close(s);
+  inbuf.clear();
+  lock_guard<mutex> lock(mtx);
+  next_unsent = 0;
+}
+
+bool Uplink::read_acks() {
+  char buf[4096];
+  ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+  if (n == 0)
+    return false;
+  if (n < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  inbuf.append(buf, n);
+
+  return parse_frames(inbuf, [&](FrameType type, const uint8_t *p,
+                                 uint32_t len) {
+    if (type != FrameType::Ack || len != 8)
+      return false;
+    uint64_t seq;
+    memcpy(&seq, p, 8);
+    // CRITICAL SECTION
+    lock_guard<mutex> lock(mtx);
+    while (!pending.empty() && pending.front().seq <= seq) {
+      pending_events -= pending.front().events;
+      acked += pending.front().events;
+      pending.pop_front();
+      if (next_unsent > 0)
+        next_unsent--;
+    }
+    return true;
+  });
+}
+
+// Seal (the open batch if old enough, or always with flush), send what
+// this connection hasn't seen yet, pick up acks. False if the link broke.
+bool Uplink::pump(bool flush) {
+  deque<vector<wifi_deauth_event_t>> raw;
+  {
+    // CRITICAL SECTION
+    lock_guard<mutex> lock(mtx);
+    if (!open.empty() && (flush || now_us() - open_since >= batch_us))
+      seal_locked();
+    raw.swap(unencoded);
+    unencoded_events = 0;
+  }
+
+  // encoding 512 events takes a while, send() mustn't wait for it
+  vector<Batch> encoded;
+  for (auto &events : raw) {
+    uint64_t seq = next_seq++;
+    string payload = seq_payload(seq);
+    encode_batch(events.data(), events.size(), payload);
+    encoded.push_back({seq, events.size(),
+                       make_shared<const string>(
+                           make_frame(FrameType::Batch, payload))});
+    events.clear();
+  }
+
+  vector<shared_ptr<const string>> to_send;
+  {
+    // CRITICAL SECTION
+    lock_guard<mutex> lock(mtx);
+    for (auto &batch : encoded) {
+      pending_events += batch.events;
+      pending.push_back(std::move(batch));
+    }
+    for (auto &events : raw)
+      spare.push_back(std::move(events));
+    trim_locked();
+    for (size_t i = next_unsent; i < pending.size(); ++i)
+      to_send.push_back(pending[i].frame);
+    next_unsent = pending.size();
+  }
+
+  for (const auto &frame : to_send)
+    if (!send_all(fd, *frame, 0))
+      return false;
+
+  pollfd pfd{fd, POLLIN, 0};
+  if (poll(&pfd, 1, 10) > 0)
+    return read_acks();
+  return true;
+}
+
+void Uplink::run() {
+  int backoff_ms = 250;
+  bool warned = false;
+
+  while (running) {
+    if (fd < 0) {
+      if (!connect_upstream()) {
+        if (!warned)
+          cerr << "[uplink] Can't reach " << host << ":" << port
+               << ", buffering and retrying" << endl;
+        warned = true;
+        unique_lock<mutex> lock(mtx);
+        cv.wait_for(lock, chrono::milliseconds(backoff_ms),
+                    [&] { return !running; });
+        backoff_ms = min(backoff_ms * 2, 5000);
+        continue;
+      }
+      warned = false;
+      backoff_ms = 250;
+    }
+
+    if (!pump(false)) {
+      cerr << "[uplink] Lost connection to " << host << ":" << port << endl;
+      disconnect();
+    }
+  }
+
+  // shutting down: give the aggregator a second to take the rest
+  int64_t deadline = now_us() + 1000000;
+  while (fd >= 0 && backlog() > 0 && now_us() < deadline)
+    if (!pump(true))
+      break;
+  if (backlog() > 0)
+    cerr << "[uplink] " << backlog() << " events not acked at exit" << endl;
+}
+
+// ---- aggregator side ----
+
+int open_aggregator_socket(int port) {
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  if (s < 0) {
+    cerr << "[aggregate] socket: " << strerror(errno) << endl;
+    return -1;
+  }
+  int one = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY); // nodes are other machines
+  addr.sin_port = htons(port);
+  if (bind(s, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(s, 64) < 0) {
+    cerr << "[aggregate] bind/listen on port " << port << ": "
+         << strerror(errno) << endl;
+    close(s);
+    return -1;
+  }
+  fcntl(s, F_SETFL, O_NONBLOCK);
+  cerr << "[aggregate] Listening for nodes on port " << port << endl;
+  return s;
+}
+
+// content only, no timestamp: the same sensor frame relayed by two gateways
+// differs only in when each node stamped it
+static uint64_t event_hash(const wifi_deauth_event_t &ev) {
+  const uint8_t *p = (const uint8_t *)&ev;
+  size_t n = offsetof(wifi_deauth_event_t, timestamp);
+  uint64_t h = 1469598103934665603ULL; // FNV-1a
+  for (size_t i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+namespace {
+struct NodeConn {
+  int fd = -1;
+  string peer;
+  string buf;
+  bool hello = false;
+  uint32_t node_id = 0;
+  uint64_t session = 0;
+};
+
+// Only a node's newest session is tracked, a reconnect replaces the old one
+struct NodeSession {
+  uint64_t session = 0;
+  uint64_t last_seq = 0; // newest batch taken
+};
+
+struct SeenEvent {
+  uint32_t node_id = 0;
+  int64_t ts = 0;      // node stamp
+  int64_t seen_at = 0; // our clock, for pruning
+};
+} // namespace
+
+void aggregate_events(int listen_fd, IngestQueue *queue, EventJournal *journal,
+                      SensorHealth *health, AlertEngine *alerts,
+                      FederationStats *stats) {
+  cerr << "[THREAD] aggregate_events started" << endl;
+  bool sampling = queue->config().policy == OverloadPolicy::Sample;
+  int64_t last_edge_check = now_us(), last_prune = now_us();
+
+  vector<NodeConn> conns;
+  vector<pollfd> fds;
+  unordered_map<uint32_t, NodeSession> sessions;
+  unordered_map<uint64_t, SeenEvent> recent;
+  vector<wifi_deauth_event_t> decoded;
+
+  auto handle = [&](NodeConn &c, FrameType type, const uint8_t *p,
+                    uint32_t len) {
+    if (type == FrameType::Hello && len == 12) {
+      memcpy(&c.node_id, p, 4);
+      memcpy(&c.session, p + 4, 8);
+      c.hello = true;
+      // the node restarted (or its clock moved), the old session is over
+      NodeSession &s = sessions[c.node_id];
+      if (s.session != c.session)
+        s = {c.session, 0};
+      cerr << "[aggregate] Node " << c.node_id << " connected from " << c.peer
+           << endl;
+      return true;
+    }
+    if (type != FrameType::Batch || !c.hello || len < 8)
+      return false;
+
+    NodeSession &s = sessions[c.node_id];
+    if (s.session != c.session) {
+      cerr << "[aggregate] " << c.peer << " is on a replaced session of node "
+           << c.node_id << endl;
+      return false;
+    }
+    uint64_t seq;
+    memcpy(&seq, p, 8);
+    uint64_t &last = s.last_seq;
+    if (seq <= last) { // resent, ack got lost
+      stats->duplicate_batches++;
+    } else {
+      if (!decode_batch(p + 8, len - 8, decoded))
+        return false;
+      int64_t now = now_us();
+      for (auto &ev : decoded) {
+        if (!is_heartbeat(ev)) {
+          SeenEvent &seen = recent[event_hash(ev)];
+          if (seen.seen_at != 0 && seen.node_id != c.node_id &&
+              llabs(seen.ts - ev.timestamp) <= dedup_us) {
+            stats->duplicate_events++;
+            continue;
+          }
+          seen = {c.node_id, ev.timestamp, now};
+        }
+        ingest_event(ev, ev.timestamp, queue, journal, health, alerts);
+        stats->events++;
+      }
+      last = seq;
+      stats->batches++;
+    }
+    // cumulative, so a dropped ack is covered by the next one
+    send_all(c.fd, make_frame(FrameType::Ack, seq_payload(last)),
+             MSG_DONTWAIT);
+    return true;
+  };
+
+  while (keep_running) {
+    int64_t now = now_us();
+    if (sampling && now - last_edge_check > edge_check_us) {
+      last_edge_check = now;
+      queue->flush_edges(now);
+    }
+    if (now - last_prune > 1000000) {
+      last_prune = now;
+      for (auto it = recent.begin(); it != recent.end();)
+        it = now - it->second.seen_at > 2 * dedup_us ? recent.erase(it)
+                                                      : next(it);
+    }
+
+    fds.clear();
+    fds.push_back({listen_fd, POLLIN, 0});
+    for (const auto &c : conns)
+      fds.push_back({c.fd, POLLIN, 0});
+    if (poll(fds.data(), fds.size(), 100) <= 0)
+      continue;
+
+    if (fds[0].revents & POLLIN) {
+      sockaddr_in peer{};
+      socklen_t plen = sizeof(peer);
+      int s;
+      while ((s = accept(listen_fd, (sockaddr *)&peer, &plen)) >= 0) {
+        if (conns.size() >= max_nodes) {
+          close(s);
+          continue;
+        }
+        fcntl(s, F_SETFL, O_NONBLOCK);
+        char ip[INET_ADDRSTRLEN] = "?";
+        inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+        NodeConn c;
+        c.fd = s;
+        c.peer = string(ip) + ":" + to_string(ntohs(peer.sin_port));
+        conns.push_back(std::move(c));
+        stats->nodes++;
+      }
+    }
+
+    // fds[i + 1] belongs to conns[i] as of the poll, new ones wait a round
+    size_t polled = fds.size() - 1;
+    vector<bool> dead(conns.size(), false);
+    for (size_t i = 0; i < polled; ++i) {
+      if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+      NodeConn &c = conns[i];
+      char buf[65536];
+      ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+      if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        continue;
+      if (n <= 0) {
+        dead[i] = true;
+        continue;
+      }
+      c.buf.append(buf, n);
+      if (!parse_frames(c.buf, [&](FrameType t, const uint8_t *p, uint32_t l) {
+            return handle(c, t, p, l);
+          })) {
+        stats->bad_frames++;
+        cerr << "[aggregate] Bad frame from " << c.peer << ", dropping"
+             << endl;
+        dead[i] = true;
+      }
+      if (c.buf.empty() && c.buf.capacity() > keep_buffer)
+        string().swap(c.buf); // a big frame went through, give it back
+    }
+
+    // slow or stuck nodes can't hold more than max_buffered between them
+    size_t buffered = 0;
+    for (size_t i = 0; i < conns.size(); ++i)
+      if (!dead[i])
+        buffered += conns[i].buf.capacity();
+    while (buffered > max_buffered) {
+      size_t big = conns.size();
+      for (size_t i = 0; i < conns.size(); ++i)
+        if (!dead[i] && (big == conns.size() ||
+                         conns[i].buf.capacity() > conns[big].buf.capacity()))
+          big = i;
+      if (big == conns.size())
+        break;
+      cerr << "[aggregate] Receive buffers full, dropping " << conns[big].peer
+           << endl;
+      buffered -= conns[big].buf.capacity();
+      dead[big] = true;
+    }
+    for (size_t i = conns.size(); i-- > 0;) {
+      if (!dead[i])
+        continue;
+      cerr << "[aggregate] Node " << conns[i].node_id << " (" << conns[i].peer
+           << ") disconnected" << endl;
+      close(conns[i].fd);
+      conns.erase(conns.begin() + i);
+      stats->nodes--;
+    }
+  }
+
+  for (const auto &c : conns)
+    close(c.fd);
+  cerr << "[aggregate] " << stats->batches << " batches, " << stats->events
+       << " events, " << stats->duplicate_batches << " duplicate batches, "
+       << stats->duplicate_events << " duplicate events" << endl;
+  cerr << "[THREAD] aggregate_events exiting" << endl;
+}
@@ -0,0 +1,257 @@
+#include "../include/fingerprint.h"
+#include "../include/localization.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+static const size_t lanes = 8; // pad columns to two 4-wide vectors
+static const int max_k = 16;
+// padding cells must never be picked
+static const float pad_rssi = 1e6f;
+
+void RadioMap::resize(size_t cells) {
+  num_cells = cells;
+  stride = (cells + lanes - 1) / lanes * lanes;
+  cell_x.assign(stride, 0);
+  cell_y.assign(stride, 0);
+  rssi.assign(macs.size() * stride, pad_rssi);
+}
+
+int RadioMap::sensor_index(const string &mac) const {
+  for (size_t i = 0; i < macs.size(); ++i)
+    if (macs[i] == mac)
+      return (int)i;
+  return -1;
+}
+
+void RadioMap::build_from_model(
+    const map<string, pair<double, double>> &sensors, double min_x,
+    double min_y, double max_x, double max_y, double cell_size) {
+  macs.clear();
+  for (const auto &kv : sensors)
+    macs.push_back(kv.first);
+
+  size_t nx = (size_t)floor((max_x - min_x) / cell_size + 1e-6) + 1;
+  size_t ny = (size_t)floor((max_y - min_y) / cell_size + 1e-6) + 1;
+  resize(nx * ny);
+
+  for (size_t iy = 0, c = 0; iy < ny; ++iy) {
+    for (size_t ix = 0; ix < nx; ++ix, ++c) {
+      double x = min_x + ix * cell_size, y = min_y + iy * cell_size;
+      cell_x[c] = (float)x;
+      cell_y[c] = (float)y;
+      size_t s = 0;
+      for (const auto &kv : sensors) {
+        double d = hypot(x - kv.second.first, y - kv.second.second);
+        rssi[s * stride + c] = (float)distance_to_rssi(d);
+        ++s;
+      }
+    }
+  }
+  cerr << "[fingerprint] Model map: " << nx << "x" << ny << " cells of "
+       << cell_size << " m, " << macs.size() << " sensors" << endl;
+}
+
+bool RadioMap::load_csv(const string &path,
+                        const map<string, pair<double, double>> &sensors,
+                        double cell_size) {
+  ifstream in(path);
+  if (!in) {
+    cerr << "[fingerprint] Can't open " << path << endl;
+    return false;
+  }
+  macs.clear();
+  for (const auto &kv : sensors)
+    macs.push_back(kv.first);
+
+  // grid cell -> per sensor (sum, count). A walk never lands on the same
+  // float twice, so samples only average out once they share a cell.
+  map<pair<long, long>, vector<pair<double, int>>> samples;
+  set<string> unknown;
+  size_t skipped = 0;
+  string line;
+  int lineno = 0;
+  while (getline(in, line)) {
+    ++lineno;
+    if (line.empty() || line[0] == '#' || isalpha((unsigned char)line[0]))
+      continue; // comment/header
+    float x, y;
+    char mac[32];
+    double value;
+    unsigned int b[6];
+    if (sscanf(line.c_str(), "%f,%f,%17[^,],%lf", &x, &y, mac, &value) != 4 ||
+        sscanf(mac, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3],
+               &b[4], &b[5]) != 6) {
+      cerr << "[fingerprint] " << path << ":" << lineno << ": bad sample"
+           << endl;
+      return false;
+    }
+    // any case in the survey, bytes_to_mac spelling for the lookup
+    snprintf(mac, sizeof(mac), "%02X:%02X:%02X:%02X:%02X:%02X", b[0], b[1],
+             b[2], b[3], b[4], b[5]);
+    int s = sensor_index(mac);
+    if (s < 0) { // sensor we don't know the position of
+      unknown.insert(mac);
+      skipped++;
+      continue;
+    }
+    auto &cell =
+        samples[{lround(x / cell_size), lround(y / cell_size)}];
+    cell.resize(macs.size(), {0.0, 0});
+    cell[s].first += value;
+    cell[s].second++;
+  }
+  if (!unknown.empty()) {
+    cerr << "[fingerprint] " << path << ": skipped " << skipped
+         << " samples from sensors not in the sensor map:";
+    for (const auto &mac : unknown)
+      cerr << " " << mac;
+    cerr << endl;
+  }
+  if (samples.empty()) {
+    cerr << "[fingerprint] " << path << " has no usable samples" << endl;
+    return false;
+  }
+
+  resize(samples.size());
+  size_t c = 0;
+  for (const auto &kv : samples) {
+    cell_x[c] = (float)(kv.first.first * cell_size);
+    cell_y[c] = (float)(kv.first.second * cell_size);
+    for (size_t s = 0; s < macs.size(); ++s) {
+      const auto &acc = kv.second[s];
+      if (acc.second > 0) {
+        rssi[s * stride + c] = (float)(acc.first / acc.second);
+      } else { // not heard during the walk here, ask the model
+        auto pos = sensors.at(macs[s]);
+        double d = hypot(cell_x[c] - pos.first, cell_y[c] - pos.second);
+        rssi[s * stride + c] = (float)distance_to_rssi(d);
+      }
+    }
+    ++c;
+  }
+  cerr << "[fingerprint] Calibrated map: " << num_cells << " cells of "
+       << cell_size << " m from " << path << endl;
+  return true;
+}
+
+// dist[c] += (col[c] - v)^2 for every cell
+static void accumulate(const float *col, float v, float *dist, size_t n) {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  float32x4_t vv = vdupq_n_f32(v);
+  for (size_t c = 0; c < n; c += 8) {
+    float32x4_t d0 = vsubq_f32(vld1q_f32(col + c), vv);
+    float32x4_t d1 = vsubq_f32(vld1q_f32(col + c + 4), vv);
+    vst1q_f32(dist + c, vfmaq_f32(vld1q_f32(dist + c), d0, d0));
+    vst1q_f32(dist + c + 4, vfmaq_f32(vld1q_f32(dist + c + 4), d1, d1));
+  }
+#elif defined(__SSE2__)
+  __m128 vv = _mm_set1_ps(v);
+  for (size_t c = 0; c < n; c += 8) {
+    __m128 d0 = _mm_sub_ps(_mm_loadu_ps(col + c), vv);
+    __m128 d1 = _mm_sub_ps(_mm_loadu_ps(col + c + 4), vv);
+    _mm_storeu_ps(dist + c, _mm_add_ps(_mm_loadu_ps(dist + c),
+                                       _mm_mul_ps(d0, d0)));
+    _mm_storeu_ps(dist + c + 4, _mm_add_ps(_mm_loadu_ps(dist + c + 4),
+                                           _mm_mul_ps(d1, d1)));
+  }
+#else
+  for (size_t c = 0; c < n; ++c) {
+    float d = col[c] - v;
+    dist[c] += d * d;
+  }
+#endif
+}
+
+// true if any of dist[c..c+8) is below limit
+static bool any_below(const float *dist, float limit) {
+#if defined(__ARM_NEON) && defined(__aarch64__)
+  float32x4_t lim = vdupq_n_f32(limit);
+  uint32x4_t lt = vorrq_u32(vcltq_f32(vld1q_f32(dist), lim),
+                            vcltq_f32(vld1q_f32(dist + 4), lim));
+  return vmaxvq_u32(lt) != 0;
+#elif defined(__SSE2__)
+  __m128 lim = _mm_set1_ps(limit);
+  __m128 lt = _mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(dist), lim),
+                        _mm_cmplt_ps(_mm_loadu_ps(dist + 4), lim));
+  return _mm_movemask_ps(lt) != 0;
+#else
+  for (size_t i = 0; i < lanes; ++i)
+    if (dist[i] < limit)
+      return true;
+  return false;
+#endif
+}
+
+bool RadioMap::locate(const vector<float> &live, int k, double &out_x,
+                      double &out_y) const {
+  if (num_cells == 0 || live.size() != macs.size())
+    return false;
+  k = max(1, min(k, max_k));
+
+  // scratch reused across calls, one per thread
+  static thread_local vector<float> dist;
+  dist.assign(stride, 0.0f);
+
+  int used = 0;
+  for (size_t s = 0; s < macs.size(); ++s) {
+    if (std::isnan(live[s]))
+      continue;
+    accumulate(&rssi[s * stride], live[s], dist.data(), stride);
+    used++;
+  }
+  if (used < 2)
+    return false;
+
+  // k smallest, kept sorted; whole vectors above the current k-th best are
+  // skipped without looking at the lanes
+  float best_d[max_k];
+  size_t best_c[max_k];
+  int found = 0;
+  float worst = FLT_MAX;
+  for (size_t base = 0; base < stride; base += lanes) {
+    if (!any_below(&dist[base], worst))
+      continue;
+    for (size_t c = base; c < base + lanes; ++c) {
+      float d = dist[c];
+      if (d >= worst && found == k)
+        continue;
+      int pos = found < k ? found++ : k - 1;
+      while (pos > 0 && best_d[pos - 1] > d) {
+        best_d[pos] = best_d[pos - 1];
+        best_c[pos] = best_c[pos - 1];
+        --pos;
+      }
+      best_d[pos] = d;
+      best_c[pos] = c;
+      if (found == k)
+        worst = best_d[k - 1];
+    }
+  }
+  if (found == 0 || best_d[0] >= pad_rssi)
+    return false;
+
+  double wx = 0, wy = 0, wsum = 0;
+  for (int i = 0; i < found; ++i) {
+    if (best_d[i] >= pad_rssi)
+      break;
+    double w = 1.0 / (sqrt(best_d[i]) + 1e-3);
+    wx += w * cell_x[best_c[i]];
+    wy += w * cell_y[best_c[i]];
+    wsum += w;
+  }
+  out_x = wx / wsum;
+  out_y = wy / wsum;
+  return true;
+}
@@ -0,0 +1,414 @@
+#include "../include/incidents.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <duckdb.hpp>
+#include <iostream>
+#include <sstream>
+using namespace std;
+
+static const size_t max_track_points = 64;
+
+static uint64_t mac_key(const uint8_t mac[6]) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; ++i)
+    key = (key << 8) | mac[i];
+  return key;
+}
+
+// "AA:BB:CC:DD:EE:FF" -> key, 0 if it doesn't parse
+static uint64_t mac_key(const string &mac) {
+  unsigned b[6];
+  if (sscanf(mac.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2],
+             &b[3], &b[4], &b[5]) != 6)
+    return 0;
+  uint64_t key = 0;
+  for (int i = 0; i < 6; ++i)
+    key = (key << 8) | b[i];
+  return key;
+}
+
+// More sensors, more rows and a position fix all make it less likely to be
+// one sensor's noise. Three sensors is what a fix needs.
+static void refresh_confidence(Incident &inc) {
+  double coverage = min<size_t>(inc.sensors.size(), 3) / 3.0;
+  double persistence = 1.0 - exp(-(double)inc.events / 10.0);
+  inc.confidence = coverage * persistence * (inc.track.empty() ? 0.8 : 1.0);
+}
+
+void IntervalTree::update(int n) {
+  Node &x = nodes[n];
+  x.height = 1 + max(height(x.left), height(x.right));
+  x.max_end = x.end;
+  if (x.left >= 0)
+    x.max_end = max(x.max_end, nodes[x.left].max_end);
+  if (x.right >= 0)
+    x.max_end = max(x.max_end, nodes[x.right].max_end);
+}
+
+int IntervalTree::rotate_left(int n) {
+  int r = nodes[n].right;
+  nodes[n].right = nodes[r].left;
+  nodes[r].left = n;
+  update(n);
+  update(r);
+  return r;
+}
+
+int IntervalTree::rotate_right(int n) {
+  int l = nodes[n].left;
+  nodes[n].left = nodes[l].right;
+  nodes[l].right = n;
+  update(n);
+  update(l);
+  return l;
+}
+
+int IntervalTree::rebalance(int n) {
+  update(n);
+  int balance = height(nodes[n].left) - height(nodes[n].right);
+  if (balance > 1) {
+    int l = nodes[n].left;
+    if (height(nodes[l].left) < height(nodes[l].right))
+      nodes[n].left = rotate_left(l);
+    return rotate_right(n);
+  }
+  if (balance < -1) {
+    int r = nodes[n].right;
+    if (height(nodes[r].right) < height(nodes[r].left))
+      nodes[n].right = rotate_right(r);
+    return rotate_left(n);
+  }
+  return n;
+}
+
+int IntervalTree::insert_at(int n, int slot) {
+  if (n < 0)
+    return slot;
+  const Node &s = nodes[slot];
+  const Node &x = nodes[n];
+  // ordered by (start, id) so equal starts still have one place to go
+  if (s.start < x.start || (s.start == x.start && s.id < x.id)) {
+    int child = insert_at(x.left, slot);
+    nodes[n].left = child;
+  } else {
+    int child = insert_at(x.right, slot);
+    nodes[n].right = child;
+  }
+  return rebalance(n);
+}
+
+void IntervalTree::insert(int64_t start, int64_t end, int64_t id) {
+  int slot;
+  if (!free_slots.empty()) {
+    slot = free_slots.back();
+    free_slots.pop_back();
+  } else {
+    slot = (int)nodes.size();
+    nodes.push_back(Node());
+  }
+  nodes[slot] = {start, end, end, id, -1, -1, 1};
+  root = insert_at(root, slot);
+  count++;
+}
+
+int IntervalTree::erase_min_at(int n, int &removed) {
+  if (nodes[n].left < 0) {
+    removed = n;
+    return nodes[n].right;
+  }
+  int child = erase_min_at(nodes[n].left, removed);
+  nodes[n].left = child;
+  return rebalance(n);
+}
+
+bool IntervalTree::erase_min(int64_t &id) {
+  if (root < 0)
+    return false;
+  int removed = -1;
+  root = erase_min_at(root, removed);
+  id = nodes[removed].id;
+  free_slots.push_back(removed);
+  count--;
+  return true;
+}
+
+// Reverse in-order walk (latest start first). A subtree whose max_end is
+// before the window can't hold a hit, and nothing right of a node that
+// starts after the window can either.
+void IntervalTree::collect(int n, int64_t from, int64_t to, size_t limit,
+                           vector<int64_t> &out) const {
+  if (n < 0 || out.size() >= limit)
+    return;
+  const Node &x = nodes[n];
+  if (x.max_end < from)
+    return;
+  if (x.start <= to) {
+    collect(x.right, from, to, limit, out);
+    if (out.size() >= limit)
+      return;
+    if (x.end >= from)
+      out.push_back(x.id);
+  }
+  collect(x.left, from, to, limit, out);
+}
+
+void IntervalTree::overlapping(int64_t from, int64_t to, size_t limit,
+                               vector<int64_t> &out) const {
+  collect(root, from, to, limit, out);
+}
+
+IncidentCorrelator::IncidentCorrelator(int64_t gap_us, size_t max_closed)
+    : gap_us(gap_us), max_closed(max<size_t>(max_closed, 1)) {}
+
+void IncidentCorrelator::on_event(const wifi_deauth_event_t &event) {
+  uint64_t attacker = mac_key(event.attack_mac);
+  uint64_t sensor = mac_key(event.sensor_mac);
+  int64_t ts = event.timestamp;
+
+  lock_guard<mutex> lock(mtx);
+  auto it = open_by_attacker.find(attacker);
+  if (it != open_by_attacker.end() && ts - it->second.end > gap_us) {
+    close(it->second); // quiet for too long, this is a new attack
+    open_by_attacker.erase(it);
+    it = open_by_attacker.end();
+  }
+  if (it == open_by_attacker.end()) {
+    it = open_by_attacker.emplace(attacker, Incident()).first;
+    Incident &inc = it->second;
+    char mac[18];
+    bytes_to_mac(event.attack_mac, mac);
+    inc.id = next_id++;
+    inc.attack_mac = mac;
+    inc.attacker = attacker;
+    inc.start = inc.end = ts;
+  }
+
+  Incident &inc = it->second;
+  // rows from different sensors aren't ordered yet (reorder comes later)
+  inc.start = min(inc.start, ts);
+  inc.end = max(inc.end, ts);
+  inc.events++;
+  inc.dirty = true;
+
+  IncidentSensor *s = nullptr;
+  for (auto &cand : inc.sensors)
+    if (cand.key == sensor) {
+      s = &cand;
+      break;
+    }
+  if (!s) {
+    inc.sensors.emplace_back();
+    s = &inc.sensors.back();
+    s->key = sensor;
+    bytes_to_mac(event.sensor_mac, s->mac);
+  }
+  s->events++;
+  s->frames += event.frame_count;
+  int64_t second = ts / 1000000;
+  if (s->second != second) {
+    s->second = second;
+    s->second_frames = 0;
+  }
+  s->second_frames += event.frame_count;
+  inc.frames = max(inc.frames, s->frames);
+  inc.peak_rate = max(inc.peak_rate, (double)s->second_frames);
+}
+
+void IncidentCorrelator::on_position(const string &attack_mac, double x,
+                                     double y, int64_t ts) {
+  uint64_t attacker = mac_key(attack_mac);
+  lock_guard<mutex> lock(mtx);
+  auto it = open_by_attacker.find(attacker);
+  if (it == open_by_attacker.end())
+    return; // its incident already closed
+  auto &track = it->second.track;
+  if (track.size() >= max_track_points) {
+    // keep every other point, a long attack still spans the whole track
+    size_t kept = 0;
+    for (size_t i = 0; i < track.size(); i += 2)
+      track[kept++] = track[i];
+    track.resize(kept);
+  }
+  track.push_back({ts, x, y});
+  it->second.dirty = true;
+}
+
+// lock held, inc is moved out and the caller erases it from the open map
+void IncidentCorrelator::close(Incident &inc) {
+  inc.open = false;
+  inc.dirty = true;
+  refresh_confidence(inc);
+  int64_t id = inc.id;
+  index.insert(inc.start, inc.end, id);
+  closed_dirty.push_back(id);
+  closed.emplace(id, std::move(inc));
+  closed_total++;
+}
+
+// lock held. DB keeps everything, memory only the latest, and only once
+// they are written: the earliest start can be an incident that just closed
+void IncidentCorrelator::evict() {
+  while (closed.size() > max_closed) {
+    int64_t oldest;
+    if (!index.erase_min(oldest))
+      break;
+    closed.erase(oldest);
+  }
+}
+
+void IncidentCorrelator::close_idle(int64_t now) {
+  lock_guard<mutex> lock(mtx);
+  for (auto it = open_by_attacker.begin(); it != open_by_attacker.end();) {
+    if (now - it->second.end > gap_us) {
+      close(it->second);
+      it = open_by_attacker.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void IncidentCorrelator::close_all() {
+  lock_guard<mutex> lock(mtx);
+  for (auto &kv : open_by_attacker)
+    close(kv.second);
+  open_by_attacker.clear();
+}
+
+void IncidentCorrelator::take_dirty(vector<Incident> &out) {
+  out.clear();
+  lock_guard<mutex> lock(mtx);
+  for (auto &kv : open_by_attacker) {
+    Incident &inc = kv.second;
+    if (!inc.dirty)
+      continue;
+    refresh_confidence(inc);
+    inc.dirty = false;
+    out.push_back(inc);
+  }
+  for (int64_t id : closed_dirty) {
+    Incident &inc = closed.at(id); // not evicted while dirty
+    inc.dirty = false;
+    out.push_back(inc);
+  }
+  closed_dirty.clear();
+  evict();
+}
+
+vector<Incident> IncidentCorrelator::query(int64_t from, int64_t to,
+                                           const string &attack_mac,
+                                           size_t limit) const {
+  uint64_t attacker = attack_mac.empty() ? 0 : mac_key(attack_mac);
+  vector<Incident> out;
+  vector<int64_t> ids;
+
+  lock_guard<mutex> lock(mtx);
+  for (const auto &kv : open_by_attacker) {
+    const Incident &inc = kv.second;
+    if (inc.start <= to && inc.end >= from &&
+        (attacker == 0 || inc.attacker == attacker)) {
+      out.push_back(inc);
+      refresh_confidence(out.back());
+    }
+  }
+  // with an attacker filter the limit can only be applied after filtering
+  index.overlapping(from, to, attacker == 0 ? limit : SIZE_MAX, ids);
+  size_t matched = 0;
+  for (size_t i = 0; i < ids.size() && matched < limit; ++i) {
+    auto it = closed.find(ids[i]);
+    if (it == closed.end() ||
+        (attacker != 0 && it->second.attacker != attacker))
+      continue;
+    out.push_back(it->second);
+    matched++;
+  }
+
+  sort(out.begin(), out.end(), [](const Incident &a, const Incident &b) {
+    return a.start > b.start || (a.start == b.start && a.id > b.id);
+  });
+  if (out.size() > limit)
+    out.resize(limit);
+  return out;
+}
+
+void IncidentCorrelator::set_next_id(int64_t id) {
+  lock_guard<mutex> lock(mtx);
+  next_id = max(next_id, id);
+}
+
+size_t IncidentCorrelator::open_count() const {
+  lock_guard<mutex> lock(mtx);
+  return open_by_attacker.size();
+}
+
+uint64_t IncidentCorrelator::closed_count() const {
+  lock_guard<mutex> lock(mtx);
+  return closed_total;
+}
+
+bool init_incidents(duckdb::DuckDB *db, IncidentCorrelator *incidents) {
+  duckdb::Connection con(*db);
+  // sensors is a comma separated MAC list, track a JSON [[ts,x,y],...]
+  auto created = con.Query(
+      "CREATE TABLE IF NOT EXISTS incidents (id BIGINT PRIMARY KEY, "
+      "attack_mac VARCHAR(17), start_ts BIGINT, end_ts BIGINT, is_open "
+      "BOOLEAN, sensors VARCHAR, sensor_count INT, events BIGINT, frames "
+      "BIGINT, peak_rate DOUBLE, confidence DOUBLE, track VARCHAR)");
+  if (created->HasError()) {
+    cerr << "[incidents] Can't create table: " << created->GetError() << endl;
+    return false;
+  }
+
+  // whatever a crash left open can't grow any more
+  auto reopened = con.Query("UPDATE incidents SET is_open = false "
+                            "WHERE is_open;");
+  if (reopened->HasError()) {
+    cerr << "[incidents] Can't close stale incidents: "
+         << reopened->GetError() << endl;
+    return false;
+  }
+
+  auto last = con.Query("SELECT MAX(id) FROM incidents;");
+  if (last->HasError()) {
+    cerr << "[incidents] Can't read last id: " << last->GetError() << endl;
+    return false;
+  }
+  if (!last->GetValue(0, 0).IsNull())
+    incidents->set_next_id(last->GetValue<int64_t>(0, 0) + 1);
+  return true;
+}
+
+void write_incidents(duckdb::Connection &con, IncidentCorrelator *incidents,
+                     int64_t now) {
+  incidents->close_idle(now);
+  vector<Incident> dirty;
+  incidents->take_dirty(dirty);
+  if (dirty.empty())
+    return;
+
+  // one upsert per flush, a row per incident that changed
+  ostringstream sql;
+  sql << "INSERT OR REPLACE INTO incidents VALUES ";
+  for (size_t i = 0; i < dirty.size(); ++i) {
+    const Incident &inc = dirty[i];
+    sql << (i ? ", (" : "(") << inc.id << ", '" << inc.attack_mac << "', "
+        << inc.start << ", " << inc.end << ", "
+        << (inc.open ? "true" : "false") << ", '";
+    for (size_t s = 0; s < inc.sensors.size(); ++s)
+      sql << (s ? "," : "") << inc.sensors[s].mac;
+    sql << "', " << inc.sensors.size() << ", " << inc.events << ", "
+        << inc.frames << ", " << inc.peak_rate << ", " << inc.confidence
+        << ", '[";
+    for (size_t p = 0; p < inc.track.size(); ++p)
+      sql << (p ? ",[" : "[") << inc.track[p].ts << "," << inc.track[p].x
+          << "," << inc.track[p].y << "]";
+    sql << "]')";
+  }
+  sql << ";";
+
+  auto result = con.Query(sql.str());
+  if (result->HasError())
+    cerr << "[incidents] Write failed: " << result->GetError() << endl;
+}
@@ -0,0 +1,510 @@
+#include "../include/ingest.h"
+#include "../include/esp32_to_uart.h"
+#include "../include/federation.h"
+#include "../include/incidents.h"
+#include "../include/realtime.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+using namespace std;
+
+// Time quantum for in-flight re-ordering
+// Tune
+static const int64_t quantum = 2000000; // 2s
+
+// How often the reader looks for attacks that ended (Sample policy)
+static const int64_t edge_check_us = 100000;
+
+// How long the inserter waits for an event before doing its idle work
+static const int64_t idle_check_us = 500000;
+
+static uint64_t mac_key(const uint8_t mac[6]) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; ++i)
+    key = (key << 8) | mac[i];
+  return key;
+}
+
+bool parse_overload_policy(const string &name, OverloadPolicy &out) {
+  if (name == "block")
+    out = OverloadPolicy::Block;
+  else if (name == "drop-oldest")
+    out = OverloadPolicy::DropOldest;
+  else if (name == "sample")
+    out = OverloadPolicy::Sample;
+  else
+    return false;
+  return true;
+}
+
+const char *overload_policy_name(OverloadPolicy policy) {
+  switch (policy) {
+  case OverloadPolicy::Block:
+    return "block";
+  case OverloadPolicy::DropOldest:
+    return "drop-oldest";
+  case OverloadPolicy::Sample:
+    return "sample";
+  }
+  return "?";
+}
+
+IngestQueue::IngestQueue(const IngestConfig &config)
+    : cfg(config), ring(max<size_t>(config.queue_capacity, 1)),
+      seqs(ring.size()), queued_at(ring.size()) {
+  if (cfg.sample_every < 1)
+    cfg.sample_every = 1;
+}
+
+// caller holds mtx
+void IngestQueue::push_locked(const wifi_deauth_event_t &event,
+                              uint64_t seq, bool must_keep) {
+  if (count == ring.size()) {
+    if (cfg.policy == OverloadPolicy::Sample && !must_keep) {
+      stats.sampled_out++;
+      return;
+    }
+    head = (head + 1) % ring.size();
+    count--;
+    stats.dropped_oldest++;
+  }
+  size_t slot = (head + count) % ring.size();
+  ring[slot] = event;
+  seqs[slot] = seq;
+  queued_at[slot] = now_us();
+  count++;
+  stats.enqueued++;
+  if (count > stats.max_depth)
+    stats.max_depth = count;
+}
+
+void IngestQueue::push(const wifi_deauth_event_t &event, uint64_t seq) {
+  stats.received++;
+  unique_lock<mutex> lock(mtx);
+
+  switch (cfg.policy) {
+  case OverloadPolicy::Block:
+    if (count == ring.size()) {
+      stats.blocked++;
+      not_full.wait(lock,
+                    [this] { return count < ring.size() || !keep_running; });
+      if (count == ring.size())
+        return; // shutting down
+    }
+    push_locked(event, seq, false);
+    break;
+
+  case OverloadPolicy::DropOldest:
+    push_locked(event, seq, false);
+    break;
+
+  case OverloadPolicy::Sample: {
+    AttackState &st = attacks[mac_key(event.attack_mac)];
+    bool sampling = count >= cfg.sample_above * ring.size();
+    bool first =
+        st.last_ts == 0 || event.timestamp - st.last_ts > cfg.attack_gap_us;
+
+    if (first) {
+      if (st.has_held) { // previous attack ended before flush_edges noticed
+        push_locked(st.held, st.held_seq, true);
+        stats.edges_kept++;
+        st.has_held = false;
+      }
+      st.seen = 0;
+      push_locked(event, seq, true);
+      if (sampling)
+        stats.edges_kept++;
+    } else if (!sampling || ++st.seen % cfg.sample_every == 0) {
+      // anything held back is older than this, so it wasn't the last one
+      if (st.has_held) {
+        stats.sampled_out++;
+        st.has_held = false;
+      }
+      push_locked(event, seq, false);
+    } else {
+      // hold back in case this turns out to be the last event of the attack
+      if (st.has_held)
+        stats.sampled_out++;
+      st.held = event;
+      st.held_seq = seq;
+      st.has_held = true;
+    }
+    st.last_ts = event.timestamp;
+    break;
+  }
+  }
+
+  lock.unlock();
+  not_empty.notify_one();
+}
+
+void IngestQueue::flush_edges(int64_t now) {
+  bool pushed = false;
+  // CRITICAL SECTION
+  {
+    lock_guard<mutex> lock(mtx);
+    for (auto it = attacks.begin(); it != attacks.end();) {
+      if (now - it->second.last_ts <= cfg.attack_gap_us) {
+        ++it;
+        continue;
+      }
+      if (it->second.has_held) {
+        push_locked(it->second.held, it->second.held_seq, true);
+        stats.edges_kept++;
+        pushed = true;
+      }
+      it = attacks.erase(it);
+    }
+  }
+  if (pushed)
+    not_empty.notify_one();
+}
+
+bool IngestQueue::pop(wifi_deauth_event_t &event, uint64_t &seq,
+                      int64_t timeout_us, int64_t *queued_at) {
+  unique_lock<mutex> lock(mtx);
+  auto ready = [this] { return !keep_running || count > 0; };
+  if (timeout_us < 0)
+    not_empty.wait(lock, ready);
+  else
+    not_empty.wait_for(lock, chrono::microseconds(timeout_us), ready);
+  if (count == 0)
+    return false; // stopped and drained, or timed out
+
+  event = ring[head];
+  seq = seqs[head];
+  if (queued_at)
+    *queued_at = this->queued_at[head];
+  head = (head + 1) % ring.size();
+  count--;
+  lock.unlock();
+  not_full.notify_one();
+  return true;
+}
+
+void IngestQueue::wake_all() {
+  not_empty.notify_all();
+  not_full.notify_all();
+}
+
+size_t IngestQueue::size() {
+  lock_guard<mutex> lock(mtx);
+  return count;
+}
+
+uint64_t IngestQueue::oldest_seq() {
+  lock_guard<mutex> lock(mtx);
+  uint64_t oldest = UINT64_MAX;
+  if (count > 0)
+    oldest = seqs[head];
+  if (cfg.policy != OverloadPolicy::Sample)
+    return oldest; // plain FIFO, the head is the oldest
+
+  // held back events go in late, so look at everything
+  for (size_t i = 0; i < count; ++i)
+    oldest = min(oldest, seqs[(head + i) % ring.size()]);
+  for (const auto &kv : attacks)
+    if (kv.second.has_held)
+      oldest = min(oldest, kv.second.held_seq);
+  return oldest;
+}
+
+void sort_bucket(vector<SequencedEvent> &bucket) {
+  sort(bucket.begin(), bucket.end(),
+       [](const SequencedEvent &a, const SequencedEvent &b) {
+         return !(a.event > b.event);
+       });
+}
+
+bool ingest_event(wifi_deauth_event_t &event, int64_t source_ts,
+                  IngestQueue *queue, EventJournal *journal,
+                  SensorHealth *health, AlertEngine *alerts) {
+  int64_t now = now_us();
+
+  // liveness only, never stored
+  if (is_heartbeat(event)) {
+    event.timestamp = now;
+    if (health)
+      health->on_heartbeat(event.sensor_mac, now);
+    if (alerts)
+      alerts->on_heartbeat(event.sensor_mac, now);
+    return false;
+  }
+
+  // ties and late arrivals are fine, the reorder stage sorts them
+  event.timestamp = source_ts > 0 ? min(source_ts, now) : now;
+
+  /*cerr << "[read_events] Event received: attack="
+       << bytes_to_mac(event.attack_mac)
+       << " sensor=" << bytes_to_mac(event.sensor_mac)
+       << " rssi_mean=" << (int)event.rssi_mean
+       << " frame_count=" << event.frame_count << " ts=" << event.timestamp
+       << endl;
+*/
+  if (health)
+    health->on_event(event.sensor_mac, event.timestamp);
+
+  // durable before anyone else sees it
+  uint64_t seq = journal ? journal->append(event) : 0;
+  queue->push(event, seq);
+  return true;
+}
+
+// Read events from UART and place in shared queue
+void read_events(int fd, IngestQueue *queue, EventJournal *journal,
+                 int record_fd, SensorHealth *health, AlertEngine *alerts,
+                 Uplink *uplink, ThreadStats *rt) {
+  cerr << "[THREAD] read_events started" << endl;
+  bool capture = !isatty(fd);
+  bool sampling = queue->config().policy == OverloadPolicy::Sample;
+  int64_t last_edge_check = now_us();
+  WakeupProbe probe;
+  if (rt)
+    probe.start();
+
+  while (keep_running) {
+    // reads time out every 0.5 s, so this also runs while the UART is idle
+    if (sampling && now_us() - last_edge_check > edge_check_us) {
+      last_edge_check = now_us();
+      queue->flush_edges(last_edge_check);
+    }
+
+    if (rt)
+      rt->sample_rusage(now_us());
+
+    // with --realtime, wait on the UART and the probe's timer together
+    if (probe.fd >= 0) {
+      pollfd pfd[2] = {{fd, POLLIN, 0}, {probe.fd, POLLIN, 0}};
+      if (poll(pfd, 2, 500) <= 0)
+        continue;
+      if (pfd[1].revents & POLLIN)
+        probe.fired(rt->latency);
+      if (!(pfd[0].revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+    }
+
+    wifi_deauth_event_t event;
+    if (!readSerialExact(fd, &event, sizeof(event))) {
+      if (capture) { // recorded workload is done
+        cerr << "[read_events] End of capture" << endl;
+        keep_running = false;
+        break;
+      }
+      continue;
+    }
+
+    // raw bytes exactly as the gateway sent them, replayable with --port
+    if (record_fd >= 0 &&
+        write(record_fd, &event, sizeof(event)) != (ssize_t)sizeof(event)) {
+      cerr << "[read_events] Recording failed, stopped recording" << endl;
+      record_fd = -1;
+    }
+
+    ingest_event(event, 0, queue, journal, health, alerts);
+    if (uplink) // stamped, heartbeats included
+      uplink->send(event);
+  }
+
+  cerr << "[THREAD] read_events exiting" << endl;
+}
+
+ReorderBuffer::ReorderBuffer(size_t bucket_capacity, IngestStats &stats,
+                             Sink sink)
+    : capacity(max<size_t>(bucket_capacity, 1)), stats(stats),
+      sink(std::move(sink)) {
+  // a busy 2 s quantum, grows further only if the site is busier
+  bucket.reserve(min<size_t>(capacity, 65536));
+}
+
+bool ReorderBuffer::add(const wifi_deauth_event_t &event, uint64_t seq) {
+  bool closed = false;
+  // If incoming timestamp exceeds (bucket start + quantum), or the bucket
+  // hit its cap (flood), close it
+  if (!bucket.empty()) {
+    bool late = (event.timestamp - bucket_start) > quantum;
+    bool full = bucket.size() >= capacity;
+    if (late || full) {
+      if (!late)
+        stats.early_flushes++;
+      closed = flush();
+    }
+  }
+
+  // Add incoming event to CURRENT bucket (whether new or existing)
+  if (bucket.empty())
+    bucket_start = event.timestamp;
+  bucket.push_back({event, seq});
+  return closed;
+}
+
+bool ReorderBuffer::flush() {
+  if (bucket.empty())
+    return false;
+  sort_bucket(bucket);
+  sink(bucket);
+  bucket.clear(); // keeps the capacity
+  return true;
+}
+
+bool ReorderBuffer::flush_idle(int64_t now) {
+  if (bucket.empty() || now - bucket_start <= quantum)
+    return false;
+  return flush();
+}
+
+// Append a sorted bucket to DB, returns its newest timestamp
+static int64_t append_bucket(duckdb::Appender &appender,
+                             vector<SequencedEvent> &bucket,
+                             IngestQueue *queue, atomic<int64_t> *watermark) {
+  // Append sorted bucket to DB
+  int64_t before_insert = now_us();
+  char attack_mac[18], sensor_mac[18];
+  for (const auto &queued : bucket) {
+    const wifi_deauth_event_t &current_event = queued.event;
+    /*       cerr << "[insert_events] Appending event ts=" <<
+       current_event.timestamp
+                << " attack=" << bytes_to_mac(current_event.attack_mac)
+                << " sensor=" << bytes_to_mac(current_event.sensor_mac)
+                << " rssi=" << (int)current_event.rssi_mean
+                << " frames=" << current_event.frame_count << endl;
+   */
+    bytes_to_mac(current_event.attack_mac, attack_mac);
+    bytes_to_mac(current_event.sensor_mac, sensor_mac);
+    appender.AppendRow(current_event.timestamp, (const char *)attack_mac,
+                       (const char *)sensor_mac, current_event.rssi_mean,
+                       current_event.rssi_variance, current_event.frame_count,
+                       queued.seq);
+  }
+
+  //     cerr << "[insert_events] Flushing appender..." << endl;
+  appender.Flush();
+  queue->stats.appended += bucket.size();
+  int64_t newest = bucket.empty() ? 0 : bucket.back().event.timestamp;
+  // every append moves the watermark, even a bucket of late rows (held back
+  // attack ends, slow nodes) that is all below it, or cached API responses
+  // would never see them
+  if (!bucket.empty())
+    *watermark = max(newest, watermark->load() + 1);
+  int64_t after_insert = now_us();
+  cout << "Batch insert execution time: "
+       << to_string(after_insert - before_insert) << "us" << endl;
+  return newest;
+}
+
+bool replay_journal(duckdb::DuckDB *db, EventJournal *journal,
+                    atomic<int64_t> *watermark) {
+  vector<SequencedEvent> pending;
+  if (!journal->replay(pending))
+    return false;
+
+  duckdb::Connection con(*db);
+  // rows from an older journal must never share a seq with new ones
+  auto top = con.Query("SELECT MAX(seq) FROM events;");
+  if (!top->HasError() && !top->GetValue(0, 0).IsNull())
+    journal->skip_to(top->GetValue<uint64_t>(0, 0));
+
+  if (!pending.empty()) {
+    // rows past the mark may or may not have made it before the crash, seq
+    // tells which, so only the missing ones go in
+    auto staged = con.Query("CREATE OR REPLACE TABLE journal_replay AS "
+                            "SELECT * FROM events LIMIT 0;");
+    if (staged->HasError()) {
+      cerr << "[journal] " << staged->GetError() << endl;
+      return false;
+    }
+    {
+      duckdb::Appender appender(con, "journal_replay");
+      for (const auto &p : pending)
+        appender.AppendRow(p.event.timestamp,
+                           bytes_to_mac(p.event.attack_mac).c_str(),
+                           bytes_to_mac(p.event.sensor_mac).c_str(),
+                           p.event.rssi_mean, p.event.rssi_variance,
+                           p.event.frame_count, p.seq);
+      appender.Close();
+    }
+    auto merged = con.Query(
+        "INSERT INTO events SELECT * FROM journal_replay r "
+        "WHERE NOT EXISTS (SELECT 1 FROM events e WHERE e.seq = r.seq); "
+        "DROP TABLE journal_replay;");
+    if (merged->HasError()) {
+      cerr << "[journal] " << merged->GetError() << endl;
+      return false;
+    }
+    cerr << "[journal] Replayed " << pending.size() << " events" << endl;
+  }
+  journal->commit(journal->last_seq());
+
+  auto latest = con.Query("SELECT MAX(timestamp) FROM events;");
+  if (!latest->HasError() && !latest->GetValue(0, 0).IsNull())
+    *watermark = latest->GetValue<int64_t>(0, 0);
+  return true;
+}
+
+// read events from shared queue and insert events into DB using appender
+// in-flight re-ordering
+// owns the writer connection, nothing else may use it
+void insert_events(duckdb::DuckDB *db, IngestQueue *queue, AlertEngine *alerts,
+                   IncidentCorrelator *incidents, EventJournal *journal,
+                   atomic<int64_t> *watermark, ThreadStats *rt) {
+  cerr << "[THREAD] insert_events started" << endl;
+  duckdb::Connection writer(*db);
+  duckdb::Appender appender(writer, "events");
+  int64_t newest = 0;
+  ReorderBuffer reorder(queue->config().bucket_capacity, queue->stats,
+                        [&](vector<SequencedEvent> &bucket) {
+                          newest = append_bucket(appender, bucket, queue,
+                                                 watermark);
+                          // same connection, incidents follow the rows
+                          if (incidents)
+                            write_incidents(writer, incidents, newest);
+                        });
+
+  wifi_deauth_event_t event;
+  uint64_t seq, last_seq = 0;
+  int64_t queued_at;
+  while (true) {
+    if (!queue->pop(event, seq, idle_check_us, rt ? &queued_at : nullptr)) {
+      if (!keep_running)
+        break; // stopped and drained
+      // Traffic stopped: the last bucket and incidents that went quiet
+      // would otherwise wait for the next event to reach DB
+      int64_t now = now_us();
+      if (reorder.flush_idle(now) && journal)
+        journal->commit(min(last_seq, queue->oldest_seq() - 1));
+      if (incidents)
+        write_incidents(writer, incidents, now);
+      continue;
+    }
+
+    if (rt) { // our clock on both ends, node stamps don't matter
+      int64_t now = now_us();
+      rt->latency.record(now - queued_at);
+      rt->sample_rusage(now);
+    }
+
+    // alerts see the event now, not after the reorder quantum
+    alerts->on_event(event);
+    if (incidents)
+      incidents->on_event(event);
+
+    // Everything older than what is still in flight (this event, the
+    // queue, held back samples) is now in DB or was shed
+    if (reorder.add(event, seq) && journal)
+      journal->commit(min(seq, queue->oldest_seq()) - 1);
+    last_seq = max(last_seq, seq);
+  }
+
+  // Shutting down, don't leave the last partial bucket behind
+  if (reorder.flush() && journal)
+    journal->commit(last_seq);
+  if (incidents) {
+    incidents->close_all();
+    write_incidents(writer, incidents, newest);
+  }
+
+  appender.Close();
+  cerr << "[THREAD] insert_events exiting" << endl;
+}
@@ -0,0 +1,159 @@
+#include "../include/localization.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+static double sensor_x1 = 0, sensor_y1 = 0;
+static double sensor_x2 = 2, sensor_y2 = 0;
+static double sensor_x3 = 0, sensor_y3 = 2;
+map<string, pair<double, double>> sensor_positions = {
+    {"78:1C:3C:E3:AB:CC",
+     {sensor_x1, sensor_y1}}, // put actual mac addresses ine here
+    {"00:4B:12:3C:04:B0", {sensor_x2, sensor_y2}},
+    {"78:1C:3C:2D:15:D4", {sensor_x3, sensor_y3}}};
+
+bool load_sensor_positions(const string &path) {
+  ifstream in(path);
+  if (!in) {
+    cerr << "[sensors] Can't open " << path << endl;
+    return false;
+  }
+  map<string, pair<double, double>> loaded;
+  string line;
+  int lineno = 0;
+  while (getline(in, line)) {
+    ++lineno;
+    line = line.substr(0, line.find('#'));
+    replace(line.begin(), line.end(), ',', ' ');
+    if (line.find_first_not_of(" \t\r") == string::npos)
+      continue;
+    char mac[32];
+    double x, y;
+    unsigned int b[6];
+    if (sscanf(line.c_str(), "%31s %lf %lf", mac, &x, &y) != 3 ||
+        sscanf(mac, "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3],
+               &b[4], &b[5]) != 6) {
+      cerr << "[sensors] " << path << ":" << lineno << ": expected MAC x y"
+           << endl;
+      return false;
+    }
+    // same spelling as bytes_to_mac, which is what the DB holds
+    char key[18];
+    snprintf(key, sizeof(key), "%02X:%02X:%02X:%02X:%02X:%02X", b[0], b[1],
+             b[2], b[3], b[4], b[5]);
+    loaded[key] = {x, y};
+  }
+  if (loaded.empty()) {
+    cerr << "[sensors] " << path << " lists no sensors" << endl;
+    return false;
+  }
+  sensor_positions = loaded;
+  cerr << "[sensors] " << loaded.size() << " sensors from " << path << endl;
+  return true;
+}
+
+// we might need to change from raw rssi to some regression funciton to get
+// distance, let's test this out x and y values should be fixed, only thing
+// changing is r
+std::tuple<double, double> trilaterate(double x1, double y1, double r1,
+                                       double x2, double y2, double r2,
+                                       double x3, double y3, double r3) {
+  double A = 2 * (x2 - x1);
+  double B = 2 * (y2 - y1);
+  double C = r1 * r1 - r2 * r2 - x1 * x1 + x2 * x2 - y1 * y1 + y2 * y2;
+
+  double D = 2 * (x3 - x1);
+  double E = 2 * (y3 - y1);
+  double F = r1 * r1 - r3 * r3 - x1 * x1 + x3 * x3 - y1 * y1 + y3 * y3;
+
+  double denominator = A * E - B * D;
+  if (fabs(denominator) < 1e-9)
+    return {NAN, NAN};
+
+  double x = (C * E - B * F) / denominator;
+  double y = (A * F - C * D) / denominator;
+  return {x, y};
+}
+
+bool multilateration_least_squares(const vector<pair<double, double>> &sensors,
+                                   const vector<double> &ranges, double &out_x,
+                                   double &out_y) {
+  size_t N = sensors.size();
+  if (N < 3 || ranges.size() != N)
+    return false;
+
+  // ref sensor
+  double x1 = sensors[0].first, y1 = sensors[0].second, r1 = ranges[0];
+
+  // A (N-1 x 2) and b (N-1)
+  double ATA00 = 0, ATA01 = 0, ATA11 = 0;
+  double ATb0 = 0, ATb1 = 0;
+
+  for (size_t i = 1; i < N; ++i) { // N-1
+    double xi = sensors[i].first, yi = sensors[i].second, ri = ranges[i];
+
+    double Ai0 = 2 * (xi - x1);
+    double Ai1 = 2 * (yi - y1);
+    double bi = r1 * r1 - ri * ri - x1 * x1 + xi * xi - y1 * y1 + yi * yi;
+
+    // accumulate ATA = A^T * A and ATb = A^T * b
+    ATA00 += Ai0 * Ai0;
+    ATA01 += Ai0 * Ai1;
+    ATA11 += Ai1 * Ai1;
+
+    ATb0 += Ai0 * bi;
+    ATb1 += Ai1 * bi;
+  }
+
+  double det = ATA00 * ATA11 - ATA01 * ATA01;
+  if (fabs(det) < 1e-12) {
+    return false; // degenerate or ill-conditioned
+  }
+
+  // Solve 2x2 system (ATA) * p = ATb
+  out_x = (ATb0 * ATA11 - ATA01 * ATb1) / det;
+  out_y = (ATA00 * ATb1 - ATb0 * ATA01) / det;
+  return true;
+}
+// i am realizing we may beed a custom rssi to distance function calibrated for
+// each reciever
+double rssi_to_distance(int rssi) {
+  double RSSI0 = rssi_at_1m;
+  double n = path_loss_exponent;
+
+  double exponent = (RSSI0 - rssi) / (10 * n);
+  return pow(10.0, exponent);
+}
+
+// inverse of rssi_to_distance, used by the simulator
+double distance_to_rssi(double meters) {
+  if (meters < 0.1)
+    meters = 0.1; // log blows up at the antenna
+  return rssi_at_1m - 10 * path_loss_exponent * log10(meters);
+}
+
+double rssi_to_distance_s1(int rssi) {
+  double RSSI0 = -40;
+  double n = 3.0;
+
+  double exponent = (RSSI0 - rssi) / (10 * n);
+  return pow(10.0, exponent);
+}
+
+double rssi_to_distance_s2(int rssi) {
+  double RSSI0 = -36;
+  double n = 3.0;
+
+  double exponent = (RSSI0 - rssi) / (10 * n);
+  return pow(10.0, exponent);
+}
+double rssi_to_distance_s3(int rssi) {
+  double RSSI0 = -40;
+  double n = 3.0;
+
+  double exponent = (RSSI0 - rssi) / (10 * n);
+  return pow(10.0, exponent);
+}
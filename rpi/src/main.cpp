@@ -1,10 +1,26 @@
+#include "../include/adaptive_window.h"
+#include "../include/alert_rules.h"
+#include "../include/alloc_counter.h"
+#include "../include/api_server.h"
+#include "../include/attacker_tracker.h"
+#include "../include/deauth_event.h"
 #include "../include/esp32_to_uart.h"
+#include "../include/federation.h"
+#include "../include/fingerprint.h"
+#include "../include/incidents.h"
+#include "../include/ingest.h"
+#include "../include/localization.h"
+#include "../include/options.h"
+#include "../include/query_scheduler.h"
+#include "../include/realtime.h"
+#include "../include/sensor_health.h"
 #include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
 #include <csignal>
+#include <cstdio>
 #include <cstddef>
 #include <cstdint>
 #include <duckdb.hpp>
@@ -12,7 +28,6 @@
 #include <iostream>
 #include <map>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <termios.h>
 #include <thread>
@@ -23,132 +38,9 @@
 using std::string;
 using namespace std;
 
-static double sensor_x1 = 0, sensor_y1 = 0;
-static double sensor_x2 = 2, sensor_y2 = 0;
-static double sensor_x3 = 0, sensor_y3 = 2;
-map<string, pair<double, double>> sensor_positions = {
-    {"78:1C:3C:E3:AB:CC",
-     {sensor_x1, sensor_y1}}, // put actual mac addresses ine here
-    {"00:4B:12:3C:04:B0", {sensor_x2, sensor_y2}},
-    {"78:1C:3C:2D:15:D4", {sensor_x3, sensor_y3}}};
-
-// we might need to change from raw rssi to some regression funciton to get
-// distance, let's test this out x and y values should be fixed, only thing
-// changing is r
-std::tuple<double, double> trilaterate(double x1, double y1, double r1,
-                                       double x2, double y2, double r2,
-                                       double x3, double y3, double r3) {
-  double A = 2 * (x2 - x1);
-  double B = 2 * (y2 - y1);
-  double C = r1 * r1 - r2 * r2 - x1 * x1 + x2 * x2 - y1 * y1 + y2 * y2;
-
-  double D = 2 * (x3 - x1);
-  double E = 2 * (y3 - y1);
-  double F = r1 * r1 - r3 * r3 - x1 * x1 + x3 * x3 - y1 * y1 + y3 * y3;
-
-  double denominator = A * E - B * D;
-  if (fabs(denominator) < 1e-9)
-    return {NAN, NAN};
-
-  double x = (C * E - B * F) / denominator;
-  double y = (A * F - C * D) / denominator;
-  return {x, y};
-}
-
-bool multilateration_least_squares(const vector<pair<double, double>> &sensors,
-                                   const vector<double> &ranges, double &out_x,
-                                   double &out_y) {
-  size_t N = sensors.size();
-  if (N < 3 || ranges.size() != N)
-    return false;
-
-  // ref sensor
-  double x1 = sensors[0].first, y1 = sensors[0].second, r1 = ranges[0];
-
-  // A (N-1 x 2) and b (N-1)
-  double ATA00 = 0, ATA01 = 0, ATA11 = 0;
-  double ATb0 = 0, ATb1 = 0;
-
-  for (size_t i = 1; i < N; ++i) { // N-1
-    double xi = sensors[i].first, yi = sensors[i].second, ri = ranges[i];
-
-    double Ai0 = 2 * (xi - x1);
-    double Ai1 = 2 * (yi - y1);
-    double bi = r1 * r1 - ri * ri - x1 * x1 + xi * xi - y1 * y1 + yi * yi;
-
-    // accumulate ATA = A^T * A and ATb = A^T * b
-    ATA00 += Ai0 * Ai0;
-    ATA01 += Ai0 * Ai1;
-    ATA11 += Ai1 * Ai1;
-
-    ATb0 += Ai0 * bi;
-    ATb1 += Ai1 * bi;
-  }
-
-  double det = ATA00 * ATA11 - ATA01 * ATA01;
-  if (fabs(det) < 1e-12) {
-    return false; // degenerate or ill-conditioned
-  }
-
-  // Solve 2x2 system (ATA) * p = ATb
-  out_x = (ATb0 * ATA11 - ATA01 * ATb1) / det;
-  out_y = (ATA00 * ATb1 - ATb0 * ATA01) / det;
-  return true;
-}
-// i am realizing we may beed a custom rssi to distance function calibrated for
-// each reciever
-double rssi_to_distance(int rssi) {
-  double RSSI0 =
-      -40; // RSSI at 1 meter, sensor 1: -41, sensor 2: -39, sensor 3: -41
-  double n = 3.0; // path-loss exponent, this should stay the same
-
-  double exponent = (RSSI0 - rssi) / (10 * n);
-  return pow(10.0, exponent);
-}
-
-double rssi_to_distance_s1(int rssi) {
-  double RSSI0 = -40;
-  double n = 3.0;
-
-  double exponent = (RSSI0 - rssi) / (10 * n);
-  return pow(10.0, exponent);
-}
-
-double rssi_to_distance_s2(int rssi) {
-  double RSSI0 = -36;
-  double n = 3.0;
-
-  double exponent = (RSSI0 - rssi) / (10 * n);
-  return pow(10.0, exponent);
-}
-double rssi_to_distance_s3(int rssi) {
-  double RSSI0 = -40;
-  double n = 3.0;
-
-  double exponent = (RSSI0 - rssi) / (10 * n);
-  return pow(10.0, exponent);
-}
-
-struct __attribute__((packed)) wifi_deauth_event_t {
-  uint8_t attack_mac[6];
-  uint8_t sensor_mac[6];
-  int8_t rssi_mean;
-  float rssi_variance;
-  int frame_count;
-  int64_t timestamp;
-};
-
-bool operator>(const wifi_deauth_event_t &a, const wifi_deauth_event_t &b) {
-  return a.timestamp > b.timestamp;
-}
-// Multithreading variables
-static queue<wifi_deauth_event_t> event_queue; // Shared
-static mutex event_queue_mutex;
-static condition_variable event_queue_cv;
-
-// Time quantum for in-flight re-ordering
-// Tune
-static const int64_t quantum = 2000000; // 2s
+// Newest timestamp that has been flushed to DuckDB. Readers (API cache) use it
+// to tell whether anything they computed could have changed.
+static atomic<int64_t> ingest_watermark(0);
 
 // Signal handling stuff for graceful shutdown
 // Allows Ctrl+C graceful shutdown
@@ -160,215 +52,299 @@ void signal_handler(int signal) {
   }
 }
 
-// Helper function
-int64_t now_us() {
-  using namespace std::chrono;
-  return duration_cast<microseconds>(system_clock::now().time_since_epoch())
-      .count();
-}
+int main(int argc, char **argv) {
+  signal(SIGINT, signal_handler);
 
-// Helper function
-string bytes_to_mac(const uint8_t mac[6]) {
-  char buf[18];
-  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1],
-           mac[2], mac[3], mac[4], mac[5]);
-  return std::string(buf);
-}
+  Options opts;
+  if (!parse_options(argc, argv, opts))
+    return 1;
 
-// Read events from UART and place in shared queue
-void read_events(int fd) {
-  cerr << "[THREAD] read_events started" << endl;
+  // before anything big is allocated, so all of it stays resident
+  RealtimeStats rt_stats;
+  RealtimeStats *rt = opts.realtime.enabled ? &rt_stats : nullptr;
+  if (rt)
+    lock_memory();
 
-  while (keep_running) {
-    wifi_deauth_event_t event;
-    if (!readSerialExact(fd, &event, sizeof(event))) {
-      continue;
-    }
+  // one coordinate frame for every node of a federation
+  if (!opts.sensors_path.empty() && !load_sensor_positions(opts.sensors_path))
+    return 1;
 
-    event.timestamp = now_us();
+  // UART/Serial stuff, or in aggregator mode the socket nodes connect to
+  bool aggregating = opts.aggregate_port > 0;
+  const char *portname = opts.port.c_str();
+  int fd = aggregating ? open_aggregator_socket(opts.aggregate_port)
+                       : openSerialPort(portname);
+  if (fd < 0) {
+    cerr << "[main] Failed to open "
+         << (aggregating ? "aggregator socket" : "serial port") << endl;
+    return 1;
+  }
+  if (!aggregating)
+    cerr << "[main] Serial port opened" << endl;
 
-    /*cerr << "[read_events] Event received: attack="
-         << bytes_to_mac(event.attack_mac)
-         << " sensor=" << bytes_to_mac(event.sensor_mac)
-         << " rssi_mean=" << (int)event.rssi_mean
-         << " frame_count=" << event.frame_count << " ts=" << event.timestamp
+  if (aggregating) {
+    // nodes feed us, nothing to configure
+  } else if (!isatty(fd)) {
+    cerr << "[main] " << portname << " is not a tty, replaying it as a capture"
          << endl;
-*/
-    // CRITICAL SECTION
-    {
-      lock_guard<mutex> lock(event_queue_mutex);
-      event_queue.push(event);
-    }
-    /*cerr << "[read_events] Event pushed to queue (size=" << event_queue.size()
-         << ")" << endl;
-*/
-    event_queue_cv.notify_one();
+  } else if (!configureSerialPort(fd, B115200)) {
+    close(fd);
+    cerr << "[main] Error configuring serial port" << endl;
+    return 1;
+  } else {
+    cerr << "[main] Serial port configured" << endl;
   }
 
-  cerr << "[THREAD] read_events exiting" << endl;
-}
-
-// read events from shared queue and insert events into DB using appender
-// in-flight re-ordering
-void insert_events(duckdb::Appender *appender) {
-  cerr << "[THREAD] insert_events started" << endl;
-  map<uint64_t, vector<wifi_deauth_event_t>> qbuckets;
-  uint64_t current_qbucket = 0;
-  int rows = 0;
-
-  while (keep_running || !event_queue.empty()) {
-    wifi_deauth_event_t event;
-
-    // CRITICAL SECTION
-    {
-      unique_lock<mutex> lock(event_queue_mutex);
-      event_queue_cv.wait(lock,
-                          [] { return !keep_running || !event_queue.empty(); });
-
-      if (event_queue.empty()) {
-        cerr << "[insert_events] Woke up but queue empty" << endl;
-        continue;
-      }
-
-      event = event_queue.front();
-      event_queue.pop();
-      // cerr << "[insert_events] Popped event from queue" << endl;
-    }
-
-    // Set the first quantum bucket index as the first timestamp
-    if (rows == 0) {
-      current_qbucket = event.timestamp;
-      /*cerr << "[insert_events] Starting first qbucket at " << current_qbucket
-           << endl; */
+  int record_fd = -1;
+  if (!opts.record_path.empty()) {
+    record_fd = open(opts.record_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                     0644);
+    if (record_fd < 0) {
+      close(fd);
+      cerr << "[main] Can't open " << opts.record_path << endl;
+      return 1;
     }
+  }
 
-    // If incoming timestamp exceeds (current index + quantum)
-    if ((event.timestamp - current_qbucket) > quantum) {
-      /*cerr << "[insert_events] Closing qbucket " << current_qbucket << " with
-         "
-           << qbuckets[current_qbucket].size() << " events" << endl;
-*/
-      // Sort completed bucket (the OLD bucket)
-      sort(qbuckets[current_qbucket].begin(), qbuckets[current_qbucket].end(),
-           [](const wifi_deauth_event_t &a, const wifi_deauth_event_t &b) {
-             return !(a > b);
-           });
-
-      // Append sorted bucket to DB
-      int64_t before_insert = now_us();
-      for (const auto &current_event : qbuckets[current_qbucket]) {
-        /*       cerr << "[insert_events] Appending event ts=" <<
-           current_event.timestamp
-                    << " attack=" << bytes_to_mac(current_event.attack_mac)
-                    << " sensor=" << bytes_to_mac(current_event.sensor_mac)
-                    << " rssi=" << (int)current_event.rssi_mean
-                    << " frames=" << current_event.frame_count << endl;
-       */
-        appender->AppendRow(current_event.timestamp,
-                            bytes_to_mac(current_event.attack_mac).c_str(),
-                            bytes_to_mac(current_event.sensor_mac).c_str(),
-                            current_event.rssi_mean,
-                            current_event.rssi_variance,
-                            current_event.frame_count);
-      }
-
-      //     cerr << "[insert_events] Flushing appender..." << endl;
-      appender->Flush();
-      int64_t after_insert = now_us();
-      cout << "Batch insert execution time: "
-           << to_string(after_insert - before_insert) << "us" << endl;
+  // Configure DuckDB
+  duckdb::DuckDB db(opts.db_path.empty() ? nullptr : opts.db_path.c_str());
+  {
+    duckdb::Connection setup(db);
+    setup.Query("CREATE TABLE IF NOT EXISTS events (timestamp BIGINT, "
+                "attack_mac VARCHAR(17), sensor_mac VARCHAR(17), rssi_mean "
+                "INT, rssi_variance FLOAT, frame_count INT, seq UBIGINT)");
+    // journal sequence (0 = not journaled), older files lack it
+    setup.Query("ALTER TABLE events ADD COLUMN IF NOT EXISTS seq UBIGINT");
+    setup.Query(
+        "CREATE INDEX IF NOT EXISTS idx_timestamp ON events (timestamp)");
+  }
+  cerr << "[main] DuckDB initialized and tables ready" << endl;
 
-      // Clean up old bucket and move to new one
-      qbuckets.erase(current_qbucket);
-      current_qbucket = event.timestamp; // ← Now update to new bucket
-      //    cerr << "[insert_events] New qbucket=" << current_qbucket << endl;
+  // Recover whatever a crash left in the journal before taking new events
+  EventJournal journal(opts.journal_dir, opts.journal_segment_bytes,
+                       opts.journal_fsync_ms,
+                       opts.db_path.empty() ? opts.journal_keep_bytes : 0);
+  EventJournal *journal_ptr = nullptr;
+  if (!opts.journal_dir.empty()) {
+    if (!replay_journal(&db, &journal, &ingest_watermark) || !journal.start()) {
+      close(fd);
+      cerr << "[main] Journal unusable" << endl;
+      return 1;
     }
-
-    // Add incoming event to CURRENT bucket (whether new or existing)
-    qbuckets[current_qbucket].push_back(event);
-    /* cerr << "[insert_events] Added event to current bucket ("
-          << qbuckets[current_qbucket].size() << " total)" << endl; */
-
-    rows++;
+    journal_ptr = &journal;
   }
 
-  cerr << "[THREAD] insert_events exiting" << endl;
-}
-
-int main() {
-  signal(SIGINT, signal_handler);
-
-  // UART/Serial stuff
-  const char *portname = "/dev/serial0";
-  int fd = openSerialPort(portname);
-  if (fd < 0) {
-    cerr << "[main] Failed to open serial port" << endl;
-    return 1;
+  AlertEngine alerts;
+  if (!opts.rules_path.empty()) {
+    if (!alerts.load(opts.rules_path)) {
+      close(fd);
+      return 1;
+    }
+    alerts.start();
   }
-  cerr << "[main] Serial port opened" << endl;
 
-  if (!configureSerialPort(fd, B115200)) {
+  // Events from every sensor grouped into per-attacker incidents
+  IncidentCorrelator incidents(opts.incident_gap_s * 1000000LL,
+                               opts.incident_memory);
+  if (!init_incidents(&db, &incidents)) {
     close(fd);
-    cerr << "[main] Error configuring serial port" << endl;
     return 1;
   }
-  cerr << "[main] Serial port configured" << endl;
 
-  // Configure DuckDB
-  duckdb::DuckDB db(nullptr);
-  duckdb::Connection con(db);
-  con.Query("CREATE TABLE IF NOT EXISTS events (timestamp BIGINT, attack_mac "
-            "VARCHAR(17), sensor_mac VARCHAR(17), rssi_mean INT, rssi_variance "
-            "FLOAT, frame_count INT)");
-  con.Query("CREATE INDEX idx_timestamp ON events (timestamp)");
-  cerr << "[main] DuckDB initialized and tables ready" << endl;
-
-  duckdb::Appender appender(con, "events");
+  // Radio map for the fingerprint locator, over the sensors plus a margin
+  bool use_fingerprint = opts.locator == "fingerprint";
+  RadioMap radio_map;
+  if (use_fingerprint) {
+    if (!opts.radio_map_path.empty()) {
+      if (!radio_map.load_csv(opts.radio_map_path, sensor_positions,
+                              opts.map_cell)) {
+        close(fd);
+        return 1;
+      }
+    } else {
+      double min_x = 1e9, min_y = 1e9, max_x = -1e9, max_y = -1e9;
+      for (const auto &kv : sensor_positions) {
+        min_x = min(min_x, kv.second.first);
+        min_y = min(min_y, kv.second.second);
+        max_x = max(max_x, kv.second.first);
+        max_y = max(max_y, kv.second.second);
+      }
+      radio_map.build_from_model(sensor_positions, min_x - 2, min_y - 2,
+                                 max_x + 2, max_y + 2, opts.map_cell);
+    }
+  }
+  vector<float> live(radio_map.sensor_macs().size());
 
   // Start producer and consumer threads
-  thread producer(read_events, fd);
-  thread consumer(insert_events, &appender);
+  // consumer owns the only writer connection
+  IngestQueue queue(opts.ingest);
+  cerr << "[main] Ingest queue " << opts.ingest.queue_capacity
+       << " events, overload policy "
+       << overload_policy_name(opts.ingest.policy) << endl;
+  SensorHealth health(opts.sensor_stale_s * 1000000LL,
+                      opts.sensor_offline_s * 1000000LL);
+  Uplink uplink(opts.upstream_host, opts.upstream_port, opts.node_id,
+                opts.upstream_backlog);
+  Uplink *uplink_ptr = nullptr;
+  if (opts.upstream_port > 0 && uplink.start())
+    uplink_ptr = &uplink;
+  FederationStats federation;
+  thread producer([&] {
+    if (rt)
+      enter_realtime(rt->reader, opts.realtime.reader_cpu,
+                     opts.realtime.reader_priority);
+    if (aggregating)
+      aggregate_events(fd, &queue, journal_ptr, &health, &alerts,
+                       &federation);
+    else
+      read_events(fd, &queue, journal_ptr, record_fd, &health, &alerts,
+                  uplink_ptr, rt ? &rt->reader : nullptr);
+  });
+  thread consumer([&] {
+    if (rt)
+      enter_realtime(rt->inserter, opts.realtime.inserter_cpu, 0);
+    insert_events(&db, &queue, &alerts, &incidents, journal_ptr,
+                  &ingest_watermark, rt ? &rt->inserter : nullptr);
+  });
 
   cerr << "[main] Threads started" << endl;
 
+  // All reads go through the scheduler's reader connections
+  QueryScheduler scheduler(db, opts.readers, opts.max_queued_queries);
+  scheduler.start();
+
+  // Query API runs on its own threads
+  AttackerTracker tracker;
+  ApiServer api(scheduler, ingest_watermark, tracker, opts.api_port,
+                opts.api_workers, opts.api_backlog, opts.api_timeout_ms);
+  api.set_ingest_stats(&queue.stats);
+  api.set_sensor_health(&health);
+  api.set_incidents(&incidents);
+  if (opts.api_port > 0 && !api.start())
+    cerr << "[main] Query API disabled" << endl;
+
   // Keep main thread running
+  AdaptiveWindow windows(opts.window_min_ms * 1000LL,
+                         opts.window_max_ms * 1000LL);
+  // sensors needed before a fix is worth trying
+  const size_t need = use_fingerprint ? 2 : 3;
+  int64_t last_health_report = 0;
+  // per cycle scratch, kept across cycles so our own buffers stop allocating
+  // once grown. DuckDB still allocates for every query and result row, so
+  // only ingest is held to zero (deauthdetect_bench --alloc-check).
+  char query_buf[640];
+  string query;
+  vector<string> slot_attackers;
+  vector<WindowSlot> slots;
+  vector<SensorAverage> readings;
+  vector<SensorStatus> health_report;
+  vector<double> distances;
+  vector<pair<double, double>> coords; // to store triang resulkts
+  uint64_t last_allocs = alloc_count();
+  // sleeps report how late they woke up in realtime mode
+  auto nap = [&](int64_t ms) {
+    int64_t start = now_us();
+    this_thread::sleep_for(chrono::milliseconds(ms));
+    if (rt) {
+      int64_t now = now_us();
+      rt->analysis.latency.record(now - start - ms * 1000);
+      rt->analysis.sample_rusage(now);
+    }
+  };
+  // pinned last, threads started above keep the default affinity
+  if (rt)
+    enter_realtime(rt->analysis, opts.realtime.analysis_cpu, 0);
   while (keep_running) {
     // SQL QUERIES FOR ANALYSIS HERE!
-    // con.Query("SELECT .....");
-
-    // most recent timestemp
-    // could just choose top index, if that makes it any faster, n
-    auto latest_ts_result = con.Query("SELECT MAX(timestamp) FROM events;");
-    if (latest_ts_result->HasError() ||
-        latest_ts_result->GetValue(0, 0).IsNull()) {
-      this_thread::sleep_for(chrono::milliseconds(200));
-      continue;
-    }
+    // both queries run in one snapshot so the window matches MAX(timestamp)
+    uint64_t ts_max = 0, ts_min = 0;
+    unique_ptr<duckdb::MaterializedQueryResult> result;
 
-    uint64_t ts_max = latest_ts_result->GetValue<uint64_t>(0, 0);
-    uint64_t window_us = 2000000; // for a 2ms window
-    uint64_t ts_min = ts_max - window_us;
-
-    // add main query here
-    string query = "SELECT "
+    int64_t before_query = now_us();
+    string error;
+    bool ok = scheduler.run(
+        QueryPriority::Analysis, opts.analysis_timeout_ms, true,
+        [&](duckdb::Connection &con) {
+          // most recent timestemp
+          // could just choose top index, if that makes it any faster, n
+          auto latest_ts_result =
+              con.Query("SELECT MAX(timestamp) FROM events;");
+          if (latest_ts_result->HasError())
+            throw runtime_error(latest_ts_result->GetError());
+          if (latest_ts_result->GetValue(0, 0).IsNull())
+            return; // nothing ingested yet
+
+          ts_max = latest_ts_result->GetValue<uint64_t>(0, 0);
+          ts_min = ts_max - windows.max_window();
+
+          // add main query here
+          // sums per (attacker, sensor, slot) over the widest window, so
+          // every attacker can pick its own window from one result
+          long long slot = windows.slot_width();
+          snprintf(query_buf, sizeof(query_buf),
+                   "SELECT "
+                   "    attack_mac, "
                    "    sensor_mac, "
-                   "    AVG(rssi_mean) as avg_rssi, "
-                   "    AVG(rssi_variance) as avg_variance, "
-                   "    SUM(frame_count) as total_frames "
+                   "    (timestamp // %lld) * %lld as slot, "
+                   "    SUM(rssi_mean) as rssi_sum, "
+                   "    SUM(rssi_variance) as variance_sum, "
+                   "    SUM(frame_count) as total_frames, "
+                   "    COUNT(*) as events "
                    "FROM events "
-                   "WHERE timestamp >= " +
-                   to_string(ts_min) +
-                   " "
-                   "  AND timestamp <= " +
-                   to_string(ts_max) +
-                   " "
-                   "GROUP BY sensor_mac;";
+                   "WHERE timestamp > %llu "
+                   "  AND timestamp <= %llu "
+                   "GROUP BY attack_mac, sensor_mac, slot "
+                   "ORDER BY attack_mac;",
+                   slot, slot, (unsigned long long)ts_min,
+                   (unsigned long long)ts_max);
+          query.assign(query_buf);
+
+          result = con.Query(query); // check if fails
+          if (result->HasError())
+            throw runtime_error(result->GetError());
+        },
+        error);
+
+    // sensors that could still show up if an attacker's window widens
+    size_t alive = 0, stale = 0, offline = 0;
+    health.report(now_us(), health_report);
+    for (const auto &st : health_report) {
+      if (st.state == SensorState::Online)
+        alive++;
+      else if (st.state == SensorState::Stale)
+        stale++;
+      else
+        offline++;
+    }
+    alive += stale;
+
+    // an attack that stopped is over even if nothing else comes in
+    incidents.close_idle(now_us());
+
+    // sensor health report, also while nothing is coming in at all
+    if (now_us() - last_health_report >= 2000000) {
+      last_health_report = now_us();
+      cout << "[health] online=" << alive - stale << " stale=" << stale
+           << " offline=" << offline << endl;
+      for (const auto &st : health_report) {
+        if (st.state != SensorState::Offline)
+          continue;
+        cout << "[health] offline: " << st.sensor_mac;
+        if (st.last_seen == 0)
+          cout << " (never heard from)" << endl;
+        else
+          cout << " (last seen " << (now_us() - st.last_seen) / 1000000
+               << " s ago)" << endl;
+      }
+    }
 
-    int64_t before_query = now_us();
-    auto result = con.Query(query); // check if fails
-    if (result->HasError()) {
-      cerr << "[main] Query failed: " << result->GetError() << endl;
-      this_thread::sleep_for(chrono::milliseconds(200));
+    if (!ok) {
+      cerr << "[main] Query failed: " << error << endl;
+      nap(200);
+      continue;
+    }
+    if (!result) {
+      nap(200);
       continue;
     }
     int64_t after_query = now_us();
@@ -376,114 +352,180 @@ int main() {
          << to_string(after_query - before_query) << "us" << endl;
     // cout << "  [debug] result struct: " << result.ToString() << "\n";
 
-    // row count of this result should ideally be 3, if not, then we prob
-    // need to expand window to hit all 3 sensors
-
-    struct SensorReading { // calculating the averages on the window
-      string sensor_mac;
-      float avg_rssi;
-      float avg_variance;
-      int frame_count; // maybe rename
-    };
-    vector<SensorReading> readings;
-    readings.reserve(result->RowCount());
-
-    // iterate through the 3 sensors and populate the readings vec
-    for (size_t i = 0; i < result->RowCount(); ++i) {
-      SensorReading sr;
+    // rows go to slots[0, rows); both vectors only grow, so the MAC strings
+    // are assigned in place instead of copied out of ToString() every row
+    size_t rows = result->RowCount();
+    if (slots.size() < rows) {
+      slots.resize(rows);
+      slot_attackers.resize(rows);
+    }
+
+    // iterate through the rows and populate the slots vec
+    for (size_t i = 0; i < rows; ++i) {
+      WindowSlot &ws = slots[i];
       // column order from the SQL:
-      // 0 = sensor_mac, 1 = avg_rssi, 2 = avg_variance, 3 = frame_count
-      sr.sensor_mac = result->GetValue(0, i).ToString();
-      sr.avg_rssi = static_cast<float>(result->GetValue<double>(1, i));
-      sr.avg_variance = static_cast<float>(result->GetValue<double>(2, i));
-      sr.frame_count = result->GetValue<int32_t>(3, i);
-      readings.push_back(std::move(sr));
+      // 0 = attack_mac, 1 = sensor_mac, 2 = slot, 3 = rssi_sum,
+      // 4 = variance_sum, 5 = total_frames, 6 = events
+      slot_attackers[i].assign(
+          duckdb::StringValue::Get(result->GetValue(0, i)));
+      ws.sensor_mac.assign(duckdb::StringValue::Get(result->GetValue(1, i)));
+      ws.slot = result->GetValue<int64_t>(2, i);
+      ws.rssi_sum = result->GetValue<double>(3, i);
+      ws.variance_sum = result->GetValue<double>(4, i);
+      ws.frames = result->GetValue<int64_t>(5, i);
+      ws.events = result->GetValue<int64_t>(6, i);
     }
 
-    cout << "\nWindow " << ts_min << " to " << ts_max << " → "
-         << readings.size() << " sensors\n";
-
-    for (auto &r : readings) {
-      cout << "  Sensor: " << r.sensor_mac << "  coords=("
-           << sensor_positions[r.sensor_mac].first << ", "
-           << sensor_positions[r.sensor_mac].second << ")"
-           << "  avg_rssi=" << r.avg_rssi
-           << "  calculated dist=" << rssi_to_distance(r.avg_rssi)
-           << "  var=" << r.avg_variance << "  frames=" << r.frame_count
-           << "\n";
-
-    } // debug prints
-
-    // distance and triangulation math!!!
-    vector<double> distances;
-    vector<pair<double, double>> coords; // to store triang resulkts
-
-    for (auto &r : readings) { // iterate through the 3 sensors
-      if (sensor_positions.find(r.sensor_mac) ==
-          sensor_positions.end()) { // no corresponding mac
-        cerr << "[WARN] Unknown sensor MAC: " << r.sensor_mac << "\n";
-        continue;
+    cout << "\nWindow " << ts_min << " to " << ts_max << " → " << rows
+         << " slots\n";
+
+    // rows are ordered by attacker, so each attacker is one contiguous run
+    for (size_t begin = 0; begin < rows;) {
+      size_t end = begin;
+      while (end < rows && slot_attackers[end] == slot_attackers[begin])
+        ++end;
+      const string &attack_mac = slot_attackers[begin];
+      size_t used = 0;
+      int64_t window_us =
+          windows.select(attack_mac, &slots[begin], end - begin, ts_max,
+                         min(need, alive), readings, used);
+      cout << "Attacker: " << attack_mac << "  window=" << window_us / 1000
+           << "ms\n";
+
+      // distance and triangulation math!!!
+      distances.clear();
+      coords.clear();
+
+      for (size_t k = 0; k < used; ++k) {
+        const SensorAverage &r = readings[k];
+        cout << "  Sensor: " << r.sensor_mac << "  coords=("
+             << sensor_positions[r.sensor_mac].first << ", "
+             << sensor_positions[r.sensor_mac].second << ")"
+             << "  avg_rssi=" << r.avg_rssi
+             << "  calculated dist=" << rssi_to_distance(r.avg_rssi)
+             << "  var=" << r.avg_variance << "  frames=" << r.frame_count
+             << "\n"; // debug prints
+
+        if (sensor_positions.find(r.sensor_mac) ==
+            sensor_positions.end()) { // no corresponding mac
+          cerr << "[WARN] Unknown sensor MAC: " << r.sensor_mac << "\n";
+          continue;
+        }
+
+        auto [sx, sy] = sensor_positions[r.sensor_mac];
+
+        // convert rssi to distance
+        double dist = rssi_to_distance(r.avg_rssi);
+
+        distances.push_back(dist);
+        coords.push_back({sx, sy});
       }
 
-      auto [sx, sy] = sensor_positions[r.sensor_mac];
-
-      // convert rssi to distance
-      double dist = rssi_to_distance(r.avg_rssi);
+      double px, py;
+      bool fixed = false;
+      if (use_fingerprint) {
+        fill(live.begin(), live.end(), NAN);
+        for (size_t k = 0; k < used; ++k) {
+          int s = radio_map.sensor_index(readings[k].sensor_mac);
+          if (s >= 0)
+            live[s] = readings[k].avg_rssi;
+        }
+        fixed = radio_map.locate(live, opts.knn_k, px, py);
+        if (fixed)
+          cout << "[FP] kNN position: (" << px << "," << py << ")\n";
+        else
+          cout << "[FP] not enough sensors for a fingerprint fix\n";
+      } else if (multilateration_least_squares(coords, distances, px, py)) {
+        cout << "[TRI] LS position: (" << px << "," << py << ")\n";
+        fixed = true;
+      } else {
+        cout << "[TRI] LS failed — trying direct trilaterate if exactly 3 "
+                "sensors.\n";
+        if (coords.size() == 3) {
+          auto [x, y] =
+              trilaterate(coords[0].first, coords[0].second, distances[0],
+                          coords[1].first, coords[1].second, distances[1],
+                          coords[2].first, coords[2].second, distances[2]);
+          cout << "[TRI] direct: (" << x << "," << y << ")\n";
+          if (!std::isnan(x) && !std::isnan(y)) {
+            px = x;
+            py = y;
+            fixed = true;
+          }
+        }
+      }
 
-      distances.push_back(dist);
-      coords.push_back({sx, sy});
-    }
-    // if (distances.size() ==
-    //     3) { // need to check theres enough sensors to trilaterate
-    //   double r1 = distances[0];
-    //   double r2 = distances[1];
-    //   double r3 = distances[2];
-
-    //   double sx1 = coords[0].first, sy1 = coords[0].second;
-    //   double sx2 = coords[1].first, sy2 = coords[1].second;
-    //   double sx3 = coords[2].first, sy3 = coords[2].second;
-
-    //   auto [x, y] = trilaterate(sx1, sy1, r1, sx2, sy2, r2, sx3, sy3, r3);
-
-    //   if (std::isnan(x) || std::isnan(y)) {
-    //     cout << "[TRILATERATION] Failed — geometry degenerate\n";
-    //   } else {
-    //     cout << "[TRILATERATION] Position estimate: (" << x << ", " << y
-    //          << ")\n";
-    //   }
-    // } else {
-    //   cout << "[TRILATERATION] Not enough sensors: " << distances.size()
-    //        << " available\n";
-    // }
-    double px, py;
-    if (multilateration_least_squares(coords, distances, px, py)) {
-      cout << "[TRI] LS position: (" << px << "," << py << ")\n";
-    } else {
-      cout << "[TRI] LS failed — trying direct trilaterate if exactly 3 "
-              "sensors.\n";
-      if (coords.size() == 3) {
-        auto [x, y] =
-            trilaterate(coords[0].first, coords[0].second, distances[0],
-                        coords[1].first, coords[1].second, distances[1],
-                        coords[2].first, coords[2].second, distances[2]);
-        cout << "[TRI] direct: (" << x << "," << y << ")\n";
+      if (fixed) {
+        tracker.update({attack_mac, px, py, (int)used,
+                        (int64_t)ts_max - window_us, (int64_t)ts_max,
+                        now_us()});
+        alerts.on_position(attack_mac, px, py, now_us());
+        incidents.on_position(attack_mac, px, py, (int64_t)ts_max);
       }
+      begin = end;
     }
+    windows.prune(ts_max);
     int64_t after_ls = now_us();
-    cout << "LS latency: " << to_string(after_ls - before_query) << "us"
+    cout << (use_fingerprint ? "FP" : "LS")
+         << " latency: " << to_string(after_ls - before_query) << "us"
          << endl;
 
-    this_thread::sleep_for(chrono::seconds(2));
+    // load shedding telemetry
+    cout << "[ingest] queue=" << queue.size()
+         << " max_depth=" << queue.stats.max_depth
+         << " received=" << queue.stats.received
+         << " dropped_oldest=" << queue.stats.dropped_oldest
+         << " sampled_out=" << queue.stats.sampled_out
+         << " edges_kept=" << queue.stats.edges_kept
+         << " blocked=" << queue.stats.blocked
+         << " early_flushes=" << queue.stats.early_flushes << endl;
+    cout << "[incidents] open=" << incidents.open_count()
+         << " closed=" << incidents.closed_count() << endl;
+    if (alloc_tracking_enabled()) {
+      uint64_t allocs = alloc_count();
+      cout << "[alloc] total=" << allocs << " cycle=" << allocs - last_allocs
+           << " bytes=" << alloc_bytes() << endl;
+      last_allocs = allocs;
+    }
+    if (aggregating)
+      cout << "[federation] nodes=" << federation.nodes
+           << " batches=" << federation.batches
+           << " events=" << federation.events
+           << " duplicate_batches=" << federation.duplicate_batches
+           << " duplicate_events=" << federation.duplicate_events
+           << " bad_frames=" << federation.bad_frames << endl;
+    if (uplink_ptr)
+      cout << "[uplink] connected=" << uplink.connected()
+           << " backlog=" << uplink.backlog()
+           << " acked=" << uplink.acked_events()
+           << " dropped=" << uplink.dropped_events() << endl;
+    if (rt)
+      for (const ThreadStats *ts : {&rt->reader, &rt->inserter, &rt->analysis})
+        cout << "[rt] " << ts->report() << endl;
+
+    nap(2000);
   }
 
   // Shutdown
   cerr << "[main] Shutdown requested, joining threads..." << endl;
 
-  close(fd);
-  event_queue_cv.notify_all();
+  api.stop();
+  scheduler.stop();
+  if (!aggregating)
+    close(fd); // unblocks the reader
+  queue.wake_all();
   producer.join();
+  if (aggregating)
+    close(fd);
+  uplink.stop(); // unacked events are lost here, the local DB has them
+  if (record_fd >= 0)
+    close(record_fd);
   consumer.join();
-  appender.Close();
+  journal.stop();
+  alerts.stop();
+  if (rt)
+    for (const ThreadStats *ts : {&rt->reader, &rt->inserter, &rt->analysis})
+      cerr << "[rt] " << ts->report() << endl;
 
   cerr << "[main] Clean exit" << endl;
   return 0;
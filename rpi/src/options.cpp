@@ -0,0 +1,240 @@
+#include "../include/options.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+static void print_usage(const char *prog) {
+  cerr << "Usage: " << prog << " [options]\n"
+       << "  --port PATH          serial device (default /dev/serial0) or a\n"
+       << "                       capture file, replayed until EOF\n"
+       << "  --record FILE        save raw events for later replay\n"
+       << "  --db PATH            DuckDB file (default in-memory)\n"
+       << "  --journal DIR        write-ahead journal of raw events "
+          "(default off)\n"
+       << "  --journal-segment-mb N\n"
+       << "                       journal segment size (default 4)\n"
+       << "  --journal-fsync-ms N group fsync interval (default 100)\n"
+       << "  --journal-keep-mb N  journal kept and replayed without --db "
+          "(default 256)\n"
+       << "  --api-port N         query API port on 127.0.0.1, 0 = off "
+          "(default 8080)\n"
+       << "  --api-workers N      query API worker threads (default 2)\n"
+       << "  --api-backlog N      max connections waiting for a worker "
+          "(default 64)\n"
+       << "  --readers N          DuckDB reader connections (default 2)\n"
+       << "  --max-queued N       max queries waiting for a reader "
+          "(default 128)\n"
+       << "  --api-timeout-ms N   timeout for API queries (default 2000)\n"
+       << "  --analysis-timeout-ms N\n"
+       << "                       timeout for the analysis loop (default "
+          "5000)\n"
+       << "  --queue-capacity N   events between reader and inserter "
+          "(default 65536)\n"
+       << "  --bucket-capacity N  max events held for re-ordering "
+          "(default 200000)\n"
+       << "  --overload POLICY    block | drop-oldest | sample (default "
+          "sample)\n"
+       << "  --sample-every N     keep 1 of N events per attacker when "
+          "sampling (default 10)\n"
+       << "  --sample-above F     queue fill ratio where sampling starts "
+          "(default 0.5)\n"
+       << "  --attack-gap-ms N    silence that ends an attack (default 5000)\n"
+       << "  --rules FILE         alert rules (see rpi/config/alert_rules.conf)"
+          "\n"
+       << "  --locator NAME       ls | fingerprint (default ls)\n"
+       << "  --radio-map FILE     calibration walks for fingerprinting, one\n"
+       << "                       x,y,sensor_mac,rssi per line (default: "
+          "model grid)\n"
+       << "  --map-cell M         radio map grid spacing in meters, calibration\n"
+       << "                       samples are snapped to it (default 0.05)\n"
+       << "  --knn N              cells averaged per fingerprint fix "
+          "(default 4)\n"
+       << "  --window-min-ms N    shortest localization window (default "
+          "500)\n"
+       << "  --window-max-ms N    longest localization window (default "
+          "16000)\n"
+       << "  --sensor-stale-s N   silence before a sensor is stale "
+          "(default 12)\n"
+       << "  --sensor-offline-s N silence before a sensor is offline "
+          "(default 30)\n"
+       << "  --sensors FILE       sensor map, MAC x y per line (see "
+          "rpi/config/sensors.conf)\n"
+       << "  --upstream HOST:PORT stream events to an aggregator\n"
+       << "  --node-id N          this node's id, required with --upstream\n"
+       << "  --upstream-backlog N events kept while the aggregator is "
+          "unreachable (default 1000000)\n"
+       << "  --aggregate PORT     aggregator mode: take events from nodes "
+          "instead of a serial port\n"
+       << "  --incident-gap-s N   quiet time that closes an incident "
+          "(default 30)\n"
+       << "  --incident-memory N  closed incidents kept in memory for the "
+          "API (default 100000)\n"
+       << "  --realtime R,I,A     pin reader, inserter and analysis to these "
+          "cores\n"
+       << "                       (-1 = any), SCHED_FIFO reader, lock memory\n"
+       << "  --rt-priority N      reader SCHED_FIFO priority, 1-99 (default "
+          "50)\n";
+}
+
+bool parse_options(int argc, char **argv, Options &opts) {
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+      print_usage(argv[0]);
+      return false;
+    }
+    if (!val) {
+      cerr << "[options] Missing value for " << arg << endl;
+      print_usage(argv[0]);
+      return false;
+    }
+
+    if (strcmp(arg, "--port") == 0) {
+      opts.port = val;
+    } else if (strcmp(arg, "--record") == 0) {
+      opts.record_path = val;
+    } else if (strcmp(arg, "--db") == 0) {
+      opts.db_path = val;
+    } else if (strcmp(arg, "--journal") == 0) {
+      opts.journal_dir = val;
+    } else if (strcmp(arg, "--journal-segment-mb") == 0) {
+      opts.journal_segment_bytes = strtoul(val, nullptr, 10) * 1024 * 1024;
+    } else if (strcmp(arg, "--journal-keep-mb") == 0) {
+      opts.journal_keep_bytes = strtoul(val, nullptr, 10) * 1024 * 1024;
+    } else if (strcmp(arg, "--journal-fsync-ms") == 0) {
+      opts.journal_fsync_ms = atoi(val);
+    } else if (strcmp(arg, "--api-port") == 0) {
+      opts.api_port = atoi(val);
+    } else if (strcmp(arg, "--api-workers") == 0) {
+      opts.api_workers = atoi(val);
+    } else if (strcmp(arg, "--api-backlog") == 0) {
+      opts.api_backlog = atoi(val);
+    } else if (strcmp(arg, "--readers") == 0) {
+      opts.readers = atoi(val);
+    } else if (strcmp(arg, "--max-queued") == 0) {
+      opts.max_queued_queries = atoi(val);
+    } else if (strcmp(arg, "--api-timeout-ms") == 0) {
+      opts.api_timeout_ms = atoi(val);
+    } else if (strcmp(arg, "--analysis-timeout-ms") == 0) {
+      opts.analysis_timeout_ms = atoi(val);
+    } else if (strcmp(arg, "--queue-capacity") == 0) {
+      opts.ingest.queue_capacity = strtoul(val, nullptr, 10);
+    } else if (strcmp(arg, "--bucket-capacity") == 0) {
+      opts.ingest.bucket_capacity = strtoul(val, nullptr, 10);
+    } else if (strcmp(arg, "--overload") == 0) {
+      if (!parse_overload_policy(val, opts.ingest.policy)) {
+        cerr << "[options] Unknown overload policy " << val << endl;
+        return false;
+      }
+    } else if (strcmp(arg, "--sample-every") == 0) {
+      opts.ingest.sample_every = atoi(val);
+    } else if (strcmp(arg, "--sample-above") == 0) {
+      opts.ingest.sample_above = atof(val);
+    } else if (strcmp(arg, "--attack-gap-ms") == 0) {
+      opts.ingest.attack_gap_us = atoll(val) * 1000;
+    } else if (strcmp(arg, "--rules") == 0) {
+      opts.rules_path = val;
+    } else if (strcmp(arg, "--locator") == 0) {
+      if (strcmp(val, "ls") != 0 && strcmp(val, "fingerprint") != 0) {
+        cerr << "[options] Unknown locator " << val << endl;
+        return false;
+      }
+      opts.locator = val;
+    } else if (strcmp(arg, "--radio-map") == 0) {
+      opts.radio_map_path = val;
+    } else if (strcmp(arg, "--map-cell") == 0) {
+      opts.map_cell = atof(val);
+    } else if (strcmp(arg, "--knn") == 0) {
+      opts.knn_k = atoi(val);
+    } else if (strcmp(arg, "--window-min-ms") == 0) {
+      opts.window_min_ms = atoi(val);
+    } else if (strcmp(arg, "--window-max-ms") == 0) {
+      opts.window_max_ms = atoi(val);
+    } else if (strcmp(arg, "--sensor-stale-s") == 0) {
+      opts.sensor_stale_s = atoi(val);
+    } else if (strcmp(arg, "--sensor-offline-s") == 0) {
+      opts.sensor_offline_s = atoi(val);
+    } else if (strcmp(arg, "--sensors") == 0) {
+      opts.sensors_path = val;
+    } else if (strcmp(arg, "--upstream") == 0) {
+      const char *colon = strrchr(val, ':');
+      if (!colon || colon == val || atoi(colon + 1) <= 0) {
+        cerr << "[options] --upstream wants HOST:PORT" << endl;
+        return false;
+      }
+      opts.upstream_host.assign(val, colon - val);
+      opts.upstream_port = atoi(colon + 1);
+    } else if (strcmp(arg, "--node-id") == 0) {
+      opts.node_id = (uint32_t)strtoul(val, nullptr, 10);
+    } else if (strcmp(arg, "--upstream-backlog") == 0) {
+      opts.upstream_backlog = strtoul(val, nullptr, 10);
+    } else if (strcmp(arg, "--aggregate") == 0) {
+      opts.aggregate_port = atoi(val);
+    } else if (strcmp(arg, "--incident-gap-s") == 0) {
+      opts.incident_gap_s = atoi(val);
+    } else if (strcmp(arg, "--incident-memory") == 0) {
+      opts.incident_memory = strtoul(val, nullptr, 10);
+    } else if (strcmp(arg, "--realtime") == 0) {
+      if (!parse_realtime_cpus(val, opts.realtime)) {
+        cerr << "[options] --realtime wants three cores, e.g. 3,2,1" << endl;
+        return false;
+      }
+    } else if (strcmp(arg, "--rt-priority") == 0) {
+      opts.realtime.reader_priority = atoi(val);
+    } else {
+      cerr << "[options] Unknown option " << arg << endl;
+      print_usage(argv[0]);
+      return false;
+    }
+    ++i;
+  }
+
+  if (opts.upstream_port > 0 && opts.node_id == 0) {
+    cerr << "[options] --upstream needs a nonzero --node-id" << endl;
+    return false;
+  }
+  if (opts.aggregate_port > 0 &&
+      (opts.upstream_port > 0 || !opts.record_path.empty())) {
+    cerr << "[options] --aggregate takes no --upstream or --record" << endl;
+    return false;
+  }
+
+  if (opts.api_workers < 1)
+    opts.api_workers = 1;
+  if (opts.api_backlog < 1)
+    opts.api_backlog = 1;
+  if (opts.journal_fsync_ms < 1)
+    opts.journal_fsync_ms = 1;
+  if (opts.ingest.queue_capacity < 1)
+    opts.ingest.queue_capacity = 1;
+  if (opts.ingest.bucket_capacity < 1)
+    opts.ingest.bucket_capacity = 1;
+  if (opts.readers < 1)
+    opts.readers = 1;
+  if (opts.max_queued_queries < 1)
+    opts.max_queued_queries = 1;
+  if (opts.map_cell < 0.01)
+    opts.map_cell = 0.01;
+  if (opts.knn_k < 1)
+    opts.knn_k = 1;
+  if (opts.window_min_ms < 2)
+    opts.window_min_ms = 2;
+  if (opts.window_max_ms < opts.window_min_ms)
+    opts.window_max_ms = opts.window_min_ms;
+  if (opts.sensor_stale_s < 1)
+    opts.sensor_stale_s = 1;
+  if (opts.incident_gap_s < 1)
+    opts.incident_gap_s = 1;
+  if (opts.incident_memory < 1)
+    opts.incident_memory = 1;
+  if (opts.realtime.reader_priority < 1)
+    opts.realtime.reader_priority = 1;
+  if (opts.realtime.reader_priority > 99)
+    opts.realtime.reader_priority = 99;
+  if (opts.sensor_offline_s < opts.sensor_stale_s)
+    opts.sensor_offline_s = opts.sensor_stale_s;
+  return true;
+}
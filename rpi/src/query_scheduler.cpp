@@ -0,0 +1,202 @@
+#include "../include/query_scheduler.h"
+#include "../include/deauth_event.h"
+#include <chrono>
+#include <iostream>
+using namespace std;
+
+static const char *timeout_error = "query timed out";
+
+QueryScheduler::QueryScheduler(duckdb::DuckDB &db, int readers,
+                               size_t max_queued)
+    : db(db), max_queued(max_queued) {
+  for (int i = 0; i < readers; ++i) {
+    slots.emplace_back(new Slot());
+    slots.back()->con.reset(new duckdb::Connection(db));
+  }
+}
+
+QueryScheduler::~QueryScheduler() { stop(); }
+
+void QueryScheduler::start() {
+  running = true;
+  for (auto &slot : slots)
+    threads.emplace_back(&QueryScheduler::reader_loop, this, slot.get());
+  watchdog = thread(&QueryScheduler::watchdog_loop, this);
+  cerr << "[sched] " << slots.size() << " reader connections ready" << endl;
+}
+
+void QueryScheduler::stop() {
+  vector<shared_ptr<Job>> left;
+  // CRITICAL SECTION
+  {
+    // under the lock, or a reader could miss the wakeup and a submit()
+    // could still queue behind the drain
+    lock_guard<mutex> lock(jobs_mutex);
+    if (!running.exchange(false))
+      return;
+    while (!jobs.empty()) {
+      left.push_back(jobs.top());
+      jobs.pop();
+    }
+  }
+  jobs_cv.notify_all();
+  for (auto &slot : slots)
+    slot->con->Interrupt();
+  for (auto &t : threads)
+    t.join();
+  threads.clear();
+  watchdog.join();
+
+  // fail whatever never got a reader
+  for (auto &job : left)
+    job->done.set_value("scheduler stopped");
+}
+
+ScheduledResult QueryScheduler::query(const string &sql, QueryPriority prio,
+                                      int timeout_ms) {
+  ScheduledResult out;
+  out.error = submit(prio, timeout_ms, false, [&](duckdb::Connection &con) {
+    auto result = con.Query(sql);
+    if (result->HasError())
+      throw runtime_error(result->GetError());
+    out.result = std::move(result);
+  });
+  out.timed_out = out.error == timeout_error;
+  if (!out.error.empty())
+    out.result.reset();
+  return out;
+}
+
+bool QueryScheduler::run(QueryPriority prio, int timeout_ms, bool snapshot,
+                         const function<void(duckdb::Connection &)> &fn,
+                         string &error) {
+  error = submit(prio, timeout_ms, snapshot, fn);
+  return error.empty();
+}
+
+string QueryScheduler::submit(QueryPriority prio, int timeout_ms,
+                              bool snapshot,
+                              function<void(duckdb::Connection &)> fn) {
+  auto job = make_shared<Job>();
+  job->prio = prio;
+  job->deadline_us = now_us() + (int64_t)timeout_ms * 1000;
+  job->snapshot = snapshot;
+  job->fn = std::move(fn);
+  auto done = job->done.get_future();
+
+  // CRITICAL SECTION
+  {
+    lock_guard<mutex> lock(jobs_mutex);
+    if (!running)
+      return "scheduler stopped";
+    if (jobs.size() >= max_queued) {
+      rejected_jobs++;
+      return "query queue full";
+    }
+    job->seq = next_seq++;
+    jobs.push(job);
+  }
+  jobs_cv.notify_one();
+  return done.get();
+}
+
+void QueryScheduler::reader_loop(Slot *slot) {
+  duckdb::Connection &con = *slot->con;
+
+  while (true) {
+    shared_ptr<Job> job;
+    // CRITICAL SECTION
+    {
+      unique_lock<mutex> lock(jobs_mutex);
+      jobs_cv.wait(lock, [this] { return !running || !jobs.empty(); });
+      if (!running)
+        return;
+      job = jobs.top();
+      jobs.pop();
+    }
+
+    // Expired while queued, don't even start it
+    if (now_us() >= job->deadline_us) {
+      timed_out_jobs++;
+      job->done.set_value(timeout_error);
+      continue;
+    }
+
+    // CRITICAL SECTION
+    {
+      lock_guard<mutex> lock(slot->mtx);
+      slot->interrupted = false;
+      slot->deadline_us = job->deadline_us;
+    }
+
+    string error;
+    try {
+      if (job->snapshot) {
+        auto begin = con.Query("BEGIN TRANSACTION");
+        if (begin->HasError())
+          throw runtime_error(begin->GetError());
+      }
+      job->fn(con);
+      if (job->snapshot) {
+        auto commit = con.Query("COMMIT");
+        if (commit->HasError())
+          throw runtime_error(commit->GetError());
+      }
+    } catch (const exception &e) {
+      error = e.what();
+      if (job->snapshot)
+        con.Query("ROLLBACK");
+    }
+
+    bool interrupted;
+    // CRITICAL SECTION
+    {
+      lock_guard<mutex> lock(slot->mtx);
+      slot->deadline_us = 0;
+      interrupted = slot->interrupted;
+    }
+    if (interrupted) {
+      timed_out_jobs++;
+      error = timeout_error;
+    }
+    job->done.set_value(error);
+  }
+}
+
+// Interrupt anything that has run past its deadline, and fail queued jobs
+// that expired while every reader was busy, their callers are waiting
+void QueryScheduler::watchdog_loop() {
+  vector<shared_ptr<Job>> waiting, expired;
+  while (running) {
+    this_thread::sleep_for(chrono::milliseconds(10));
+    int64_t now = now_us();
+
+    // CRITICAL SECTION
+    {
+      lock_guard<mutex> lock(jobs_mutex);
+      while (!jobs.empty()) {
+        auto &job = jobs.top();
+        (now >= job->deadline_us ? expired : waiting).push_back(job);
+        jobs.pop();
+      }
+      for (auto &job : waiting)
+        jobs.push(std::move(job));
+    }
+    waiting.clear();
+    for (auto &job : expired) {
+      timed_out_jobs++;
+      job->done.set_value(timeout_error);
+    }
+    expired.clear();
+
+    for (auto &slot : slots) {
+      // CRITICAL SECTION
+      lock_guard<mutex> lock(slot->mtx);
+      if (slot->deadline_us != 0 && now >= slot->deadline_us &&
+          !slot->interrupted) {
+        slot->interrupted = true;
+        slot->con->Interrupt();
+      }
+    }
+  }
+}
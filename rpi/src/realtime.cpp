@@ -0,0 +1,219 @@
+#include "../include/realtime.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+using namespace std;
+
+// deepest the ingest threads go (DuckDB appends included), with room
+static const size_t prefault_bytes = 256 * 1024;
+
+bool parse_realtime_cpus(const string &list, RealtimeConfig &out) {
+  int cpus[3];
+  const char *p = list.c_str();
+  for (int i = 0; i < 3; ++i) {
+    char *end;
+    long v = strtol(p, &end, 10);
+    if (end == p || v < -1 || v >= CPU_SETSIZE)
+      return false;
+    cpus[i] = (int)v;
+    if (i < 2) {
+      if (*end != ',')
+        return false;
+      p = end + 1;
+    } else if (*end != '\0') {
+      return false;
+    }
+  }
+  out.enabled = true;
+  out.reader_cpu = cpus[0];
+  out.inserter_cpu = cpus[1];
+  out.analysis_cpu = cpus[2];
+  return true;
+}
+
+void LatencyHistogram::record(int64_t us) {
+  if (us < 0)
+    us = 0;
+  int b = us == 0 ? 0 : 64 - __builtin_clzll((uint64_t)us);
+  if (b >= buckets)
+    b = buckets - 1;
+  // single writer, no need for a locked add
+  hist[b].store(hist[b].load(memory_order_relaxed) + 1,
+                memory_order_relaxed);
+  if (us > max_us.load(memory_order_relaxed))
+    max_us.store(us, memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+  uint64_t n = 0;
+  for (int i = 0; i < buckets; ++i)
+    n += hist[i].load(memory_order_relaxed);
+  return n;
+}
+
+int64_t LatencyHistogram::percentile(double q) const {
+  uint64_t n = count();
+  if (n == 0)
+    return 0;
+  uint64_t want = (uint64_t)(q * n);
+  if (want >= n)
+    want = n - 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < buckets; ++i) {
+    seen += hist[i].load(memory_order_relaxed);
+    if (seen > want)
+      return i == 0 ? 1 : (1LL << i);
+  }
+  return max();
+}
+
+void ThreadStats::sample_rusage(int64_t now) {
+  if (now - last_sample < 1000000)
+    return;
+  last_sample = now;
+  struct rusage ru;
+  if (getrusage(RUSAGE_THREAD, &ru) != 0)
+    return;
+  voluntary_switches = ru.ru_nvcsw;
+  involuntary_switches = ru.ru_nivcsw;
+}
+
+string ThreadStats::report() const {
+  ostringstream out;
+  out << name << " cpu=" << cpu.load()
+      << (fifo.load() ? " fifo " : " other ") << measures
+      << " n=" << latency.count()
+      << " p50<=" << latency.percentile(0.5) << "us"
+      << " p99<=" << latency.percentile(0.99) << "us"
+      << " max=" << latency.max() << "us"
+      << " csw=" << voluntary_switches.load() << "/"
+      << involuntary_switches.load();
+  return out.str();
+}
+
+bool lock_memory() {
+  // MCL_FUTURE under a finite limit would make later allocations (DuckDB's
+  // buffers) fail instead of this call, so only lock when it can't bite
+  struct rlimit lim;
+  if (geteuid() != 0 && getrlimit(RLIMIT_MEMLOCK, &lim) == 0 &&
+      lim.rlim_cur != RLIM_INFINITY) {
+    cerr << "[rt] Memory not locked: memlock limit is "
+         << lim.rlim_cur / 1024 << " KB (run as root or ulimit -l unlimited)"
+         << endl;
+    return false;
+  }
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    cerr << "[rt] Memory not locked: mlockall: " << strerror(errno) << endl;
+    return false;
+  }
+
+  // freed memory stays mapped (and locked), no trimming or per-allocation
+  // mmaps that would fault again later. Only worth it once it is locked.
+#ifdef __GLIBC__
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+#endif
+  cerr << "[rt] Memory locked" << endl;
+  return true;
+}
+
+// touch the stack below the caller so those pages are resident (and locked),
+// reading it back keeps the buffer alive
+__attribute__((noinline)) static int prefault_stack() {
+  volatile char buf[prefault_bytes];
+  int sum = 0;
+  for (size_t i = 0; i < prefault_bytes; i += 4096) {
+    buf[i] = 0;
+    sum += buf[i];
+  }
+  return sum;
+}
+
+static int64_t mono_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+WakeupProbe::~WakeupProbe() {
+  if (fd >= 0)
+    close(fd);
+}
+
+bool WakeupProbe::start(int64_t period_us) {
+  fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    cerr << "[rt] No wakeup probe: timerfd: " << strerror(errno) << endl;
+    return false;
+  }
+  period_ns = period_us * 1000;
+  next_ns = mono_ns() + period_ns;
+  itimerspec spec{};
+  spec.it_interval.tv_sec = period_ns / 1000000000;
+  spec.it_interval.tv_nsec = period_ns % 1000000000;
+  spec.it_value.tv_sec = next_ns / 1000000000;
+  spec.it_value.tv_nsec = next_ns % 1000000000;
+  if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    cerr << "[rt] No wakeup probe: timerfd_settime: " << strerror(errno)
+         << endl;
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  return true;
+}
+
+void WakeupProbe::fired(LatencyHistogram &hist) {
+  uint64_t ticks;
+  if (read(fd, &ticks, sizeof(ticks)) != (ssize_t)sizeof(ticks) || ticks == 0)
+    return;
+  // missed expiries were late by more than a period, the newest counts
+  int64_t newest = next_ns + (int64_t)(ticks - 1) * period_ns;
+  hist.record((mono_ns() - newest) / 1000);
+  next_ns = newest + period_ns;
+}
+
+void enter_realtime(ThreadStats &stats, int cpu, int fifo_priority) {
+  pthread_t self = pthread_self();
+  // naming the main thread would rename the process
+  if ((pid_t)syscall(SYS_gettid) != getpid())
+    pthread_setname_np(self, stats.name);
+
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(self, sizeof(set), &set);
+    if (err == 0)
+      stats.cpu = cpu;
+    else
+      cerr << "[rt] " << stats.name << " not pinned to cpu " << cpu << ": "
+           << strerror(err) << endl;
+  }
+
+  if (fifo_priority > 0) {
+    sched_param param{};
+    param.sched_priority = fifo_priority;
+    int err = pthread_setschedparam(self, SCHED_FIFO, &param);
+    if (err == 0)
+      stats.fifo = true;
+    else
+      cerr << "[rt] " << stats.name << " stays SCHED_OTHER: "
+           << strerror(err) << endl;
+  }
+
+  (void)prefault_stack();
+}
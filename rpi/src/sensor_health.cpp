@@ -0,0 +1,94 @@
+#include "../include/sensor_health.h"
+#include "../include/deauth_event.h"
+#include "../include/localization.h"
+#include <algorithm>
+#include <cstdio>
+using namespace std;
+
+static uint64_t key_of(const uint8_t mac[6]) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; ++i)
+    key = (key << 8) | mac[i];
+  return key;
+}
+
+const char *sensor_state_name(SensorState state) {
+  switch (state) {
+  case SensorState::Online:
+    return "online";
+  case SensorState::Stale:
+    return "stale";
+  default:
+    return "offline";
+  }
+}
+
+SensorHealth::SensorHealth(int64_t stale_us, int64_t offline_us)
+    : stale_us(stale_us), offline_us(max(offline_us, stale_us)) {
+  for (const auto &kv : sensor_positions) {
+    unsigned int b[6];
+    if (sscanf(kv.first.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1],
+               &b[2], &b[3], &b[4], &b[5]) != 6)
+      continue;
+    uint8_t mac[6];
+    for (int i = 0; i < 6; ++i)
+      mac[i] = (uint8_t)b[i];
+    entry(mac);
+  }
+}
+
+// caller holds mtx (or is the constructor)
+SensorHealth::Entry &SensorHealth::entry(const uint8_t mac[6]) {
+  Entry &e = sensors[key_of(mac)];
+  if (e.mac.empty())
+    e.mac = bytes_to_mac(mac);
+  return e;
+}
+
+void SensorHealth::on_event(const uint8_t mac[6], int64_t ts) {
+  // CRITICAL SECTION
+  lock_guard<mutex> lock(mtx);
+  Entry &e = entry(mac);
+  e.last_event = max(e.last_event, ts);
+  e.events++;
+}
+
+void SensorHealth::on_heartbeat(const uint8_t mac[6], int64_t ts) {
+  // CRITICAL SECTION
+  lock_guard<mutex> lock(mtx);
+  Entry &e = entry(mac);
+  e.last_heartbeat = max(e.last_heartbeat, ts);
+  e.heartbeats++;
+}
+
+void SensorHealth::report(int64_t now, vector<SensorStatus> &out) const {
+  {
+    // CRITICAL SECTION
+    lock_guard<mutex> lock(mtx);
+    // sensors are never forgotten, so this only ever grows
+    out.resize(sensors.size());
+    size_t i = 0;
+    for (const auto &kv : sensors) {
+      const Entry &e = kv.second;
+      SensorStatus &st = out[i++];
+      st.sensor_mac.assign(e.mac);
+      st.last_event = e.last_event;
+      st.last_heartbeat = e.last_heartbeat;
+      st.last_seen = max(e.last_event, e.last_heartbeat);
+      st.events = e.events;
+      st.heartbeats = e.heartbeats;
+    }
+  }
+  for (auto &st : out) {
+    int64_t age = now - st.last_seen;
+    if (st.last_seen == 0 || age > offline_us)
+      st.state = SensorState::Offline;
+    else if (age > stale_us)
+      st.state = SensorState::Stale;
+    else
+      st.state = SensorState::Online;
+  }
+  sort(out.begin(), out.end(), [](const SensorStatus &a, const SensorStatus &b) {
+    return a.sensor_mac < b.sensor_mac;
+  });
+}
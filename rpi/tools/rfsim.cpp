@@ -0,0 +1,383 @@
+// Synthetic RF environment for driving deauthdetect without hardware.
+//
+// N sensors sit at fixed positions, M attackers move along scripted
+// waypoints or random walks. For every (attacker, sensor) pair the simulator
+// draws per-frame RSSI from the same log-distance model rssi_to_distance
+// inverts, plus Gaussian shadowing, and packs it into wifi_deauth_event_t
+// exactly like a sensor would. Events go out through a pseudo-terminal that
+// deauthdetect opens with --port, or into a capture file.
+//
+//   rfsim [--sensor MAC,x,y]... [--attacker MAC=random|x,y;x,y;...]...
+//         [--rate EVENTS_PER_S] [--duration S] [--speed M_PER_S]
+//         [--sigma DB] [--frames N] [--seed N]
+//         [--heartbeat-ms N] [--link PATH] [--output FILE] [--truth FILE]
+//
+// Without --sensor the sensors from sensor_positions are used, without
+// --attacker one random walker. --truth writes the ground-truth trajectory
+// as CSV (t_us,attack_mac,x,y) on the same clock deauthdetect stamps events
+// with.
+#include "../include/deauth_event.h"
+#include "../include/esp32_to_uart.h"
+#include "../include/localization.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+struct SimSensor {
+  uint8_t mac[6];
+  double x, y;
+};
+
+struct SimAttacker {
+  uint8_t mac[6];
+  bool random_walk;
+  vector<pair<double, double>> waypoints;
+  size_t next = 1;
+  double x = 0, y = 0;
+};
+
+static atomic<bool> running(true);
+static void on_signal(int) { running = false; }
+
+static bool parse_mac(const string &s, uint8_t out[6]) {
+  unsigned int b[6];
+  if (sscanf(s.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x", &b[0], &b[1], &b[2], &b[3],
+             &b[4], &b[5]) != 6)
+    return false;
+  for (int i = 0; i < 6; ++i)
+    out[i] = (uint8_t)b[i];
+  return true;
+}
+
+static void usage(const char *prog) {
+  cerr << "Usage: " << prog << " [options]\n"
+       << "  --sensor MAC,x,y         sensor position (repeatable)\n"
+       << "  --attacker MAC=PATH      PATH is 'random' or x,y;x,y;... "
+          "(repeatable)\n"
+       << "  --rate N                 events per second, 1-100000 "
+          "(default 10)\n"
+       << "  --duration S             stop after S seconds (default: "
+          "until Ctrl+C)\n"
+       << "  --speed M                attacker speed in m/s (default 0.5)\n"
+       << "  --sigma DB               shadowing std deviation (default 2)\n"
+       << "  --frames N               frames per event (default 30)\n"
+       << "  --seed N                 random seed (default 1)\n"
+       << "  --heartbeat-ms N         sensor heartbeat period, 0 = off "
+          "(default 5000)\n"
+       << "  --link PATH              symlink PATH to the pty slave\n"
+       << "  --output FILE            write a capture file instead of a pty\n"
+       << "  --truth FILE             ground-truth trajectory CSV\n";
+}
+
+// Move an attacker dt seconds along its path
+static void step(SimAttacker &a, double dt, double speed, double min_x,
+                 double min_y, double max_x, double max_y, mt19937 &rng) {
+  double left = speed * dt;
+  size_t idle_hops = 0; // waypoints reached without moving (repeated points)
+  while (left > 0 && idle_hops <= a.waypoints.size()) {
+    if (a.next >= a.waypoints.size()) {
+      if (a.random_walk) { // reached the target, pick a new one
+        uniform_real_distribution<double> ux(min_x, max_x), uy(min_y, max_y);
+        a.waypoints.assign(1, {ux(rng), uy(rng)});
+      }
+      a.next = 0; // scripted paths loop
+    }
+
+    double tx = a.waypoints[a.next].first, ty = a.waypoints[a.next].second;
+    double d = hypot(tx - a.x, ty - a.y);
+    if (d <= left) {
+      a.x = tx;
+      a.y = ty;
+      left -= d;
+      a.next++;
+      idle_hops = d == 0 ? idle_hops + 1 : 0;
+    } else {
+      a.x += (tx - a.x) / d * left;
+      a.y += (ty - a.y) / d * left;
+      left = 0;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  vector<SimSensor> sensors;
+  vector<SimAttacker> attackers;
+  double rate = 10, duration = 0, speed = 0.5, sigma = 2;
+  int frames = 30, heartbeat_ms = 5000;
+  unsigned seed = 1;
+  string link_path, output_path, truth_path;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--help" || arg == "-h" || i + 1 >= argc) {
+      usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+    string val = argv[++i];
+    if (arg == "--sensor") {
+      SimSensor s;
+      char mac[32];
+      if (sscanf(val.c_str(), "%17[^,],%lf,%lf", mac, &s.x, &s.y) != 3 ||
+          !parse_mac(mac, s.mac)) {
+        cerr << "[rfsim] Bad --sensor " << val << endl;
+        return 1;
+      }
+      sensors.push_back(s);
+    } else if (arg == "--attacker") {
+      SimAttacker a;
+      size_t eq = val.find('=');
+      if (eq == string::npos || !parse_mac(val.substr(0, eq), a.mac)) {
+        cerr << "[rfsim] Bad --attacker " << val << endl;
+        return 1;
+      }
+      string path = val.substr(eq + 1);
+      a.random_walk = path == "random";
+      if (!a.random_walk) {
+        istringstream pts(path);
+        string pt;
+        while (getline(pts, pt, ';')) {
+          double x, y;
+          if (sscanf(pt.c_str(), "%lf,%lf", &x, &y) != 2) {
+            cerr << "[rfsim] Bad waypoint " << pt << endl;
+            return 1;
+          }
+          a.waypoints.push_back({x, y});
+        }
+        if (a.waypoints.empty()) {
+          cerr << "[rfsim] Attacker needs at least one waypoint" << endl;
+          return 1;
+        }
+      }
+      attackers.push_back(a);
+    } else if (arg == "--rate") {
+      rate = atof(val.c_str());
+    } else if (arg == "--duration") {
+      duration = atof(val.c_str());
+    } else if (arg == "--speed") {
+      speed = atof(val.c_str());
+    } else if (arg == "--sigma") {
+      sigma = atof(val.c_str());
+    } else if (arg == "--frames") {
+      frames = max(2, atoi(val.c_str()));
+    } else if (arg == "--seed") {
+      seed = strtoul(val.c_str(), nullptr, 10);
+    } else if (arg == "--heartbeat-ms") {
+      heartbeat_ms = max(0, atoi(val.c_str()));
+    } else if (arg == "--link") {
+      link_path = val;
+    } else if (arg == "--output") {
+      output_path = val;
+    } else if (arg == "--truth") {
+      truth_path = val;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  rate = min(max(rate, 1.0), 100000.0);
+
+  if (sensors.empty()) {
+    for (const auto &kv : sensor_positions) {
+      SimSensor s;
+      parse_mac(kv.first, s.mac);
+      s.x = kv.second.first;
+      s.y = kv.second.second;
+      sensors.push_back(s);
+    }
+  }
+
+  // random walkers stay within a meter of the sensor hull's bounding box
+  double min_x = sensors[0].x, max_x = sensors[0].x;
+  double min_y = sensors[0].y, max_y = sensors[0].y;
+  for (const auto &s : sensors) {
+    min_x = min(min_x, s.x);
+    max_x = max(max_x, s.x);
+    min_y = min(min_y, s.y);
+    max_y = max(max_y, s.y);
+  }
+  min_x -= 1;
+  min_y -= 1;
+  max_x += 1;
+  max_y += 1;
+
+  mt19937 rng(seed);
+  if (attackers.empty()) {
+    SimAttacker a;
+    parse_mac("DE:AD:BE:EF:00:01", a.mac);
+    a.random_walk = true;
+    attackers.push_back(a);
+  }
+  for (auto &a : attackers) {
+    if (a.random_walk) {
+      uniform_real_distribution<double> ux(min_x, max_x), uy(min_y, max_y);
+      a.waypoints.push_back({ux(rng), uy(rng)});
+    }
+    a.x = a.waypoints[0].first;
+    a.y = a.waypoints[0].second;
+  }
+
+  // Output: capture file or pty
+  int out_fd = -1;
+  if (!output_path.empty()) {
+    out_fd = open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+      cerr << "[rfsim] " << output_path << ": " << strerror(errno) << endl;
+      return 1;
+    }
+  } else {
+    out_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (out_fd < 0 || grantpt(out_fd) != 0 || unlockpt(out_fd) != 0) {
+      cerr << "[rfsim] posix_openpt: " << strerror(errno) << endl;
+      return 1;
+    }
+    const char *slave = ptsname(out_fd);
+    // same setup deauthdetect does on the real UART, so events written
+    // before it opens the port aren't cooked either
+    int slave_fd = open(slave, O_RDWR | O_NOCTTY);
+    if (slave_fd >= 0)
+      configureSerialPort(slave_fd, B115200);
+    // slave_fd stays open so the pty survives deauthdetect restarts
+    cout << "[rfsim] pty: " << slave << endl;
+    if (!link_path.empty()) {
+      unlink(link_path.c_str());
+      if (symlink(slave, link_path.c_str()) == 0)
+        cout << "[rfsim] linked " << link_path << " -> " << slave << endl;
+    }
+    cout << "[rfsim] run: deauthdetect --port "
+         << (link_path.empty() ? slave : link_path.c_str()) << endl;
+  }
+
+  FILE *truth = nullptr;
+  if (!truth_path.empty()) {
+    truth = fopen(truth_path.c_str(), "w");
+    if (!truth) {
+      cerr << "[rfsim] " << truth_path << ": " << strerror(errno) << endl;
+      return 1;
+    }
+    fprintf(truth, "t_us,attack_mac,x,y\n");
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  // Round robin over (attacker, sensor) pairs at the requested total rate
+  normal_distribution<double> shadow(0, sigma);
+  const double interval_us = 1e6 / rate;
+  const int64_t truth_every_us = 100000;
+  int64_t start = now_us(), last_step = start, last_truth = 0;
+  int64_t last_heartbeat = 0;
+  uint64_t sent = 0;
+  int64_t max_lag_us = 0; // how far behind schedule the writer got
+  size_t pair_idx = 0;
+  vector<wifi_deauth_event_t> batch;
+  const size_t batch_max = 4096;
+  batch.reserve(batch_max + sensors.size()); // room for heartbeats
+
+  while (running) {
+    int64_t now = now_us();
+    if (duration > 0 && now - start >= duration * 1e6)
+      break;
+
+    // advance the world
+    double dt = (now - last_step) / 1e6;
+    last_step = now;
+    for (auto &a : attackers)
+      step(a, dt, speed, min_x, min_y, max_x, max_y, rng);
+    if (truth && now - last_truth >= truth_every_us) {
+      for (const auto &a : attackers)
+        fprintf(truth, "%lld,%s,%.3f,%.3f\n", (long long)now,
+                bytes_to_mac(a.mac).c_str(), a.x, a.y);
+      last_truth = now;
+    }
+
+    // everything that is due by now goes out in one write
+    uint64_t due = (uint64_t)((now - start) / interval_us) + 1;
+    max_lag_us = max(max_lag_us, now - start - (int64_t)(sent * interval_us));
+    batch.clear();
+    while (sent + batch.size() < due && batch.size() < batch_max) {
+      const SimAttacker &a = attackers[pair_idx / sensors.size()];
+      const SimSensor &s = sensors[pair_idx % sensors.size()];
+      pair_idx = (pair_idx + 1) % (attackers.size() * sensors.size());
+
+      double mean_rssi = distance_to_rssi(hypot(a.x - s.x, a.y - s.y));
+      double sum = 0, sum_sq = 0;
+      for (int f = 0; f < frames; ++f) {
+        double r = mean_rssi + shadow(rng);
+        sum += r;
+        sum_sq += r * r;
+      }
+      double avg = sum / frames;
+
+      wifi_deauth_event_t ev;
+      memcpy(ev.attack_mac, a.mac, 6);
+      memcpy(ev.sensor_mac, s.mac, 6);
+      ev.rssi_mean = (int8_t)max(-127.0, min(0.0, avg)); // like the sensor
+      ev.rssi_variance = (float)((sum_sq - frames * avg * avg) / (frames - 1));
+      ev.frame_count = frames;
+      ev.timestamp = 0; // the Pi stamps arrival time
+      batch.push_back(ev);
+    }
+    size_t events = batch.size();
+
+    // heartbeats like the firmware's, not part of the event rate
+    if (heartbeat_ms > 0 && now - last_heartbeat >= heartbeat_ms * 1000LL) {
+      for (const auto &s : sensors) {
+        wifi_deauth_event_t hb;
+        memset(&hb, 0, sizeof(hb));
+        memcpy(hb.sensor_mac, s.mac, 6);
+        batch.push_back(hb);
+      }
+      last_heartbeat = now;
+    }
+
+    const char *p = (const char *)batch.data();
+    size_t left = batch.size() * sizeof(wifi_deauth_event_t);
+    while (left > 0 && running) {
+      ssize_t n = write(out_fd, p, left);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        cerr << "[rfsim] write: " << strerror(errno) << endl;
+        running = false;
+        break;
+      }
+      p += n;
+      left -= n;
+    }
+    sent += events;
+
+    // sleep until the next event is due (coarse at high rates)
+    int64_t next_due = start + (int64_t)(sent * interval_us);
+    int64_t wait = next_due - now_us();
+    if (wait > 200)
+      this_thread::sleep_for(chrono::microseconds(wait));
+  }
+
+  double secs = (now_us() - start) / 1e6;
+  cerr << "[rfsim] sent " << sent << " events in " << secs << " s ("
+       << (secs > 0 ? sent / secs : 0) << " events/s, target " << rate
+       << "), max lag " << max_lag_us / 1000 << " ms" << endl;
+
+  if (truth)
+    fclose(truth);
+  if (!link_path.empty() && output_path.empty())
+    unlink(link_path.c_str());
+  close(out_fd);
+  return 0;
+}